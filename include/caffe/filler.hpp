@@ -267,6 +267,9 @@ class BilinearFiller : public Filler<Dtype> {
 * A Filler based on the paper [Le, Jaitly and Hintion 2015]: A Simple Way 
 * to Initialize Recurrent Networks of Rectified Linear Units.
 *
+* A num x channels blob whose num is a multiple of channels is filled with
+* num / channels identity blocks on top of each other, the block-diagonal
+* recurrent weights of grouped IRNN layers.
 */
 template <typename Dtype>
 class IdentityFiller : public Filler<Dtype> {
@@ -275,8 +278,9 @@ class IdentityFiller : public Filler<Dtype> {
       : Filler<Dtype>(param) {}
   virtual void Fill(Blob<Dtype>* blob) {
     CHECK_EQ(blob->num_axes(), 2) << "Blob must be 2 dim.";
-    CHECK_EQ(blob->num(), blob->channels()) << "Filter must be 2 dim.";
-    const int n = blob->num();
+    CHECK_EQ(blob->num() % blob->channels(), 0)
+        << "Filter must be square, or a stack of square blocks.";
+    const int n = blob->channels();
     Dtype* data = blob->mutable_cpu_data();
     const int count = blob->count();
     const Dtype value = 1.;
@@ -284,8 +288,8 @@ class IdentityFiller : public Filler<Dtype> {
     for (int i = 0; i < count; ++i) {
       data[i] = Dtype(0.);
     }
-    for (int i = 0; i < n; ++i) {
-      data[i*n+i] = value;
+    for (int i = 0; i < blob->num(); ++i) {
+      data[i*n+i%n] = value;
     }
     CHECK_EQ(this->filler_param_.sparse(), -1)
          << "Sparsity not supported by this Filler.";
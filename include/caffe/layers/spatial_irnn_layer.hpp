@@ -13,6 +13,10 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/irnn_cache.hpp"
+#include "caffe/util/irnn_int8.hpp"
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/irnn_profile.hpp"
 
 namespace caffe{
 
@@ -26,27 +30,82 @@ namespace caffe{
 *parallel computing. In each direction, the merged IRNN moves forward in 
 *this direction during the forward propagation and moves backward in the 
 *opposite direction during the backward propagation. 
-*/
-template <typename Dtype>
-void Relu(const int count, Dtype* bottom_data);
 
-template <typename Dtype>
-void Grelu(const int count, Dtype* bottom_diff, const Dtype* top_data);
+*The 'axis' field of the layer parameter selects the bottom layout. With
+*axis 0 the bottom is permuted so that the scan axis comes first: 'H*C*N*W'
+*for up/down and 'W*C*H*N' for left/right. Otherwise the bottom is the
+*standard 'N*C*H*W' blob and axis is the one to scan along, 2 for up/down and
+*3 for left/right. Axis 1, the default of the layers before they honored the
+*field, also selects the permuted layout.
 
+*With 'int8' set, the forward passes of the TEST phase run on the CPU with
+*int8 weights and uint8 hidden states, see IRNNInt8, once the first
+*'int8_calibration_iter' float passes have calibrated them.
+*
+*With a non-zero 'rank' r the recurrent weights are W = I + U * V, with
+*blobs_[0] the NH x r matrix U and blobs_[1] the r x NH matrix V, instead of
+*a dense NH x NH blobs_[0]. A step then costs 4 * NH * r flops per scan line
+*instead of 2 * NH * NH.
+*
+*With 'recurrence: DIAGONAL' blobs_[0] holds NH weights, W being diagonal,
+*and a step is an elementwise multiply-add and ReLU, 3 * NH flops per scan
+*line.
+*
+*With 'group' G, W is block-diagonal: blobs_[0] is NH x NH/G, the G blocks of
+*NH/G channels on top of each other, as for the weights of a grouped
+*convolution. The blocks are swept one by one.
+*
+*With 'memoize' set, a forward pass on the same bottom and weights as the
+*previous one returns the previous top, see IRNNOutputCache. set_frozen
+*skips the check of the bottom.
+*
+*With 'incremental' set, a forward pass on the CPU keeps the hidden states
+*of the last pass for the steps before the first one whose input changed,
+*see IRNNIncremental, and only sweeps from there on.
+*
+*An optional second bottom with N x 2 values, the height and width of each
+*sample, makes the batch ragged: sample n only spans the top left
+*height x width part of the map, and its padding is zero in the top and the
+*bottom diff. On a 'N*C*H*W' bottom every sample is swept over its own
+*extent. On a permuted bottom the samples share the GEMM of each step, and
+*the sweep stops after the longest sample.
+*
+*The layer may run in place, with top and bottom the same blob: the sweep
+*then runs on the bottom itself instead of a copy of it. A forward pass
+*touches no backward buffer, so a TEST net never allocates them.
+*/
 template <typename Dtype>
-class RNNUPLayer : public Layer<Dtype>{
+class BaseIRNNLayer : public Layer<Dtype>{
  public:
-  explicit RNNUPLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+  BaseIRNNLayer(const LayerParameter& param, bool horizontal, bool reverse)
+      : Layer<Dtype>(param), horizontal_(horizontal), reverse_(reverse) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  // Takes every size but the channels from the bottom, which may change
+  // from one pass to the next, e.g. between the scales of a multi-scale
+  // search. The buffers keep the capacity of the largest pass, so cycling
+  // through a few sizes only allocates on the first cycle.
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  virtual inline const char* type() const { return "RNNUP"; }
-  virtual inline int ExactNumBottomBlobs() const { return 1; }
+  virtual inline int MinBottomBlobs() const { return 1; }
+  virtual inline int MaxBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
-  
+
+  // While frozen, the caller guarantees that the bottom does not change, so
+  // the cached top is returned as long as the weights stay the same.
+  void set_frozen(const bool frozen) { cache_.set_frozen(frozen); }
+  // With 'incremental' set, declares that the bottom of the next forward
+  // pass only changes at the rows (up/down) or columns (left/right)
+  // [begin, end) of the map.
+  void set_changed_positions(const int begin, const int end) {
+    last_pass_.set_changed_positions(begin, end);
+  }
+  // Time spent in the phases of the CPU passes so far, with Caffe built
+  // with IRNN_PROFILE, see IRNNProfile. profile().Dump(name) formats it.
+  const IRNNProfile& profile() const { return profile_; }
+  void ResetProfile() { profile_.Reset(); }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -57,99 +116,173 @@ class RNNUPLayer : public Layer<Dtype>{
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // RNNUPParameter, RNNDOWNParameter, RNNLEFTParameter and RNNRIGHTParameter
+  // share their fields. The derived layers pass theirs in LayerSetUp.
+  template <typename Param>
+  void ReadIRNNParam(const Param& param) {
+    axis_ = param.axis();
+    weight_filler_ = param.weight_filler();
+    use_int8_ = param.int8();
+    int8_calibration_iter_ = param.int8_calibration_iter();
+    bf16_storage_ = param.bf16_storage();
+    rank_ = param.rank();
+    diagonal_ = param.recurrence() == Param::DIAGONAL;
+    group_ = param.group();
+    memoize_ = param.memoize();
+    incremental_ = param.incremental();
+  }
+  // the low-rank or block-diagonal W as a NH x NH matrix in dense_w_, for
+  // the int8 weights
+  const Dtype* DenseWeights();
+  // sweeps_ and extent_ for the sample sizes of a ragged batch
+  void RaggedSweeps(const Blob<Dtype>& sizes);
+  // hh_ wide enough for one step of, and the bf16 backward pass over, each
+  // of sweeps_
+  void ReshapeHH();
+  // one sweep of the forward and backward passes with the layer's weights
+  void ForwardSweep_cpu(const IRNNSweep& sweep, const bool quantized,
+      Dtype* h, Dtype* tmp);
+  void ForwardSweep_gpu(const IRNNSweep& sweep, Dtype* h);
+  void BackwardSweep_cpu(const IRNNSweep& sweep, const Dtype* h,
+      const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry, Dtype* tmp);
+  void BackwardSweep_gpu(const IRNNSweep& sweep, const Dtype* h,
+      const Dtype* top_diff, Dtype* bottom_diff);
+
+  bool horizontal_; // left/right, otherwise up/down
+  bool reverse_;    // up/left move towards the first row/column
+  bool transpose_;  // left/right on a 'N*C*H*W' bottom run on its transpose
+  int axis_;        // scan axis of the bottom, 0 for the permuted layouts
+  FillerParameter weight_filler_;
+  bool use_int8_;   // int8 forward passes in the TEST phase
+  int int8_calibration_iter_;
+  bool bf16_storage_; // bf16 hidden states and diffs in trans_ for backward
+  int rank_;        // rank of W - I, 0 for dense recurrent weights
+  bool diagonal_;   // one recurrent weight per channel
+  int group_;       // diagonal blocks of W
+  bool memoize_;    // return the cached top on an unchanged bottom
+  bool incremental_; // resume from the first changed step
+
   int N_;  
   int NH_; // output channels
   int NX_; // input channels
-  int M_;  // height*width
   int H_;  // height
   int W_;  // width
-  Blob<Dtype> cache_; // used during backpropagation, cache.data for f_diff, cache.diff for h_diff  
+  IRNNSweep sweep_;
+  // the parts of sweep_ a pass runs, at sweep_offsets_ in the hidden states:
+  // sweep_ itself unless the batch is ragged
+  vector<IRNNSweep> sweeps_;
+  vector<int> sweep_offsets_;
+  IRNNRaggedLayout ragged_layout_; // layout of the top of a ragged batch
+  Blob<int> extent_; // scan positions and scan lines of each sample
   Blob<Dtype> hh_; // used during backpropagation, hh_.diff for hidden state to hidden state's diff
- }; 
- 
+                   // hh_.data holds V * h_prev and U^T * dz when rank_ is set
+  Blob<Dtype> trans_; // transposed hidden states (data) and diffs (diff) when transpose_ is set
+  // The CPU passes borrow the space of hh_ and trans_ from the thread's
+  // IRNNWorkspace, the blobs only give its shape there: trans_.data,
+  // trans_.diff, hh_.data and hh_.diff in this order. Without backward the
+  // diffs are left out.
+  void BorrowScratch(const bool backward, Dtype** scratch);
+  IRNNInt8<Dtype> int8_;
+  Blob<Dtype> dense_w_;
+  IRNNOutputCache<Dtype> cache_;
+  IRNNIncremental<Dtype> last_pass_;
+  IRNNProfile profile_;
+};
+
 template <typename Dtype>
-class RNNDOWNLayer : public Layer<Dtype>{
+class RNNUPLayer : public BaseIRNNLayer<Dtype>{
  public:
-  explicit RNNDOWNLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+  explicit RNNUPLayer(const LayerParameter& param)
+      : BaseIRNNLayer<Dtype>(param, false, true) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
 
-  virtual inline const char* type() const { return "RNNDOWN"; }
-  virtual inline int ExactNumBottomBlobs() const { return 1; }
-  virtual inline int ExactNumTopBlobs() const { return 1; }
-  
- protected:
-  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+  virtual inline const char* type() const { return "RNNUP"; }
+};
+
+template <typename Dtype>
+class RNNDOWNLayer : public BaseIRNNLayer<Dtype>{
+ public:
+  explicit RNNDOWNLayer(const LayerParameter& param)
+      : BaseIRNNLayer<Dtype>(param, false, false) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
-  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
-  int N_;  
-  int NH_; 
-  int NX_; 
-  int M_;  
-  int H_;  
-  int W_;  
-  Blob<Dtype> cache_;  
-  Blob<Dtype> hh_; 
- }; 
+  virtual inline const char* type() const { return "RNNDOWN"; }
+};
 
 template <typename Dtype>
-class RNNLEFTLayer : public Layer<Dtype>{
+class RNNLEFTLayer : public BaseIRNNLayer<Dtype>{
  public:
   explicit RNNLEFTLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : BaseIRNNLayer<Dtype>(param, true, true) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "RNNLEFT"; }
-  virtual inline int ExactNumBottomBlobs() const { return 1; }
-  virtual inline int ExactNumTopBlobs() const { return 1; }
-  
- protected:
-  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+};
+
+template <typename Dtype>
+class RNNRIGHTLayer : public BaseIRNNLayer<Dtype>{
+ public:
+  explicit RNNRIGHTLayer(const LayerParameter& param)
+      : BaseIRNNLayer<Dtype>(param, true, false) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
-  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
-  int N_;  
-  int NH_;
-  int NX_;
-  int M_; 
-  int H_; 
-  int W_;  
-  Blob<Dtype>  cache_;  
-  Blob<Dtype>  hh_; 
- }; 
- 
+  virtual inline const char* type() const { return "RNNRIGHT"; }
+};
 
+/**
+*@brief Spatial-IRNN block fused into one layer.
+*
+*It takes the N*C*H*W output of the 1x1 convolution as it is, runs the left,
+*right, down and up IRNNs over it and writes their hidden states into one
+*N*4C*H*W top, in this order along the channel axis. It replaces the
+*permute, RNN* and concat layers of models/example.prototxt. blobs_[0..3]
+*hold the recurrent weights of the four directions in the same order.
+*
+*The four directions do not depend on each other, and neither do the scan
+*lines within a direction. When Caffe is built with OpenMP, Forward_cpu and
+*Backward_cpu cut every direction into slabs of scan lines and sweep all
+*the slabs concurrently, each on a single thread.
+*
+*'int8' works as for the directional layers, with separate scales for each
+*direction. 'bf16_storage' halves the scratch of left and right; up and
+*down sweep their hidden states in the top and copy only their diffs.
+*'memoize' and set_frozen cache the whole top.
+*
+*A non-zero 'num_output' also folds in the 1x1 convolution that reduces the
+*concat: the top is then N*num_output*H*W, blobs_[4] holds the
+*num_output x 4C x 1 x 1 weights of that convolution and blobs_[5] its
+*biases, if 'bias_term' is set. The concat is no net blob any more: the
+*TRAIN phase keeps it in hidden_ for the backward pass, the TEST phase
+*borrows it from the IRNNWorkspace for the duration of the forward pass.
+*
+*A non-zero 'num_hidden' likewise folds in the 1x1 convolution in front of
+*the block: the bottom may then have any number of channels NX, blobs_[4 +
+*k], after the k blobs of 'num_output', holds the num_hidden x NX x 1 x 1
+*weights and the next blob the biases, if 'input_bias_term' is set. The
+*projection is computed for every position in one GEMM per sample, written
+*straight into the concat where up starts its sweep.
+*/
 template <typename Dtype>
-class RNNRIGHTLayer : public Layer<Dtype>{
+class SpatialIRNNLayer : public Layer<Dtype>{
  public:
-  explicit RNNRIGHTLayer(const LayerParameter& param)
+  explicit SpatialIRNNLayer(const LayerParameter& param)
       : Layer<Dtype>(param) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  virtual inline const char* type() const { return "RNNRIGHT"; }
+  virtual inline const char* type() const { return "SpatialIRNN"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
-  
+
+  // see BaseIRNNLayer::set_frozen
+  void set_frozen(const bool frozen) { cache_.set_frozen(frozen); }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -159,15 +292,55 @@ class RNNRIGHTLayer : public Layer<Dtype>{
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // The sweeps of Backward_cpu, given the concat of the four directions and
+  // its diff. They leave the sum of dz in input_diff unless it is NULL.
+  void BackwardSweeps_cpu(const Dtype* top_data, const Dtype* top_diff,
+      Dtype** scratch, Dtype* input_diff);
+  // the projected input of num_hidden, at the stride of the concat
+  void ForwardInput_cpu(const Dtype* bottom, Dtype* input);
+  void ForwardInput_gpu(const Dtype* bottom, Dtype* input);
+  // the diffs of the input projection, its bias and the bottom
+  void BackwardInput_cpu(const Dtype* input_diff,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  void BackwardInput_gpu(const Dtype* input_diff,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // top = P * hidden + b for the 1x1 convolution folded in with num_output
+  void ForwardProjection_cpu(const Dtype* hidden, Dtype* top);
+  void ForwardProjection_gpu(const Dtype* hidden, Dtype* top);
+  // the diffs of P and b, and hidden_.diff, from the diff of the top
+  void BackwardProjection_cpu(const Dtype* top_diff);
+  void BackwardProjection_gpu(const Dtype* top_diff);
 
-  int N_;  
-  int NH_; 
-  int NX_; 
-  int M_;  
-  int H_;  
-  int W_;  
-  Blob<Dtype>  cache_; 
-  Blob<Dtype>  hh_; 
+  int N_;
+  int NX_; // channels of the bottom
+  int NH_; // channels of each direction, NX_ without num_hidden
+  int H_;
+  int W_;
+  // sweeps of the directions, over the top for up/down and over the
+  // transposed hidden states for left/right
+  IRNNSweep sweep_[4];
+  // scratch of each direction, so that the directions can run concurrently
+  vector<shared_ptr<Blob<Dtype> > > hh_;
+  vector<shared_ptr<Blob<Dtype> > > trans_; // hidden states and diffs, transposed for left/right
+  // As BaseIRNNLayer::BorrowScratch, for the four directions one after the
+  // other. The forward pass only takes trans_.data of left and right, and
+  // in the TEST phase with num_output, the concat as scratch[16]. The
+  // backward pass takes trans_.data of left and right, trans_.diff of up
+  // and down and, without bf16_storage, of left and right, and the diff of
+  // the projected input as scratch[16].
+  void BorrowScratch(const bool backward, Dtype** scratch);
+  int num_output_; // channels of the folded 1x1 convolution, or 0
+  bool bias_term_;
+  Blob<Dtype> hidden_; // the concat of the directions with num_output
+  Blob<Dtype> bias_multiplier_;
+  bool project_input_; // with num_hidden
+  bool input_bias_term_;
+  int input_blob_; // index of the input projection in blobs_
+  Blob<Dtype> projected_; // its diff sums up dz on the GPU
+  bool use_int8_;
+  IRNNInt8<Dtype> int8_[4];
+  bool bf16_storage_;
+  IRNNOutputCache<Dtype> cache_;
 };
 
 }  // namespace caffe
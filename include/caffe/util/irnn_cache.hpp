@@ -0,0 +1,130 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#ifndef CAFFE_UTIL_IRNN_CACHE_HPP_
+#define CAFFE_UTIL_IRNN_CACHE_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/irnn_math.hpp"
+
+namespace caffe {
+
+/**
+*@brief Copy of the last top of an IRNN layer, returned again as long as
+*its bottom and its weights stay the same.
+*
+*The template branch of a Siamese tracker sees the same crop on every frame.
+*With fingerprinting on, each pass hashes the bottom and the weights, which
+*costs a read of both, and skips the recurrence when they match those of the
+*cached pass. While frozen, the caller vouches for the bottom and only the
+*weights are hashed. The top is copied out of the cache, since later layers
+*may work in place on it.
+*
+*In GPU mode the bottom, the weights and the cached top stay on the device:
+*they are hashed there by irnn_fingerprint_gpu and only the two 64-bit
+*fingerprints are read back. The GPU and CPU fingerprints differ, so a layer
+*that switches modes recomputes its first pass in the new one.
+*/
+template <typename Dtype>
+class IRNNOutputCache {
+ public:
+  IRNNOutputCache()
+      : fingerprint_(false), frozen_(false), valid_(false),
+        bottom_known_(false), next_bottom_known_(false) {}
+
+  void SetUp(const bool fingerprint) { fingerprint_ = fingerprint; }
+  void set_frozen(const bool frozen) { frozen_ = frozen; }
+  bool frozen() const { return frozen_; }
+  void Invalidate() { valid_ = false; }
+
+  // Copies the cached top into top and returns true if bottom and weights
+  // match the cached pass. Otherwise returns false and keeps their
+  // fingerprints for Store.
+  bool Restore(const Blob<Dtype>& bottom,
+      const vector<shared_ptr<Blob<Dtype> > >& weights, Blob<Dtype>* top);
+  // Caches top, computed from the inputs of the last Restore.
+  void Store(const Blob<Dtype>& top);
+  // memory held by the cached top
+  size_t bytes() const { return top_.count() * sizeof(Dtype); }
+
+ protected:
+  // next_weights_hash_, and next_bottom_hash_ if next_bottom_known_
+  void Fingerprint(const Blob<Dtype>& bottom,
+      const vector<shared_ptr<Blob<Dtype> > >& weights);
+
+  bool fingerprint_;
+  bool frozen_;
+  bool valid_;         // top_ holds a cached pass
+  bool bottom_known_;  // bottom_hash_ was taken, it is not while frozen
+  vector<int> bottom_shape_;
+  uint64_t bottom_hash_;
+  uint64_t weights_hash_;
+  // fingerprints of the pass being computed, until it is stored
+  bool next_bottom_known_;
+  vector<int> next_bottom_shape_;
+  uint64_t next_bottom_hash_;
+  uint64_t next_weights_hash_;
+  Blob<Dtype> top_;
+  shared_ptr<SyncedMemory> gpu_hashes_;  // the two sums of the GPU passes
+};
+
+#ifndef CPU_ONLY
+// Adds the fingerprint of bytes of device memory, keyed by seed, to the
+// device word *sum. Each 64-bit word is mixed with its position and the
+// mixed words are summed, so that the threads may add them in any order.
+void irnn_fingerprint_gpu(const void* data, const size_t bytes,
+    const int seed, uint64_t* sum);
+#endif
+
+/**
+*@brief Input and hidden states of the last forward pass of a sweep, to
+*resume the next pass from the first step whose input changed.
+*
+*A sweep is causal, so the hidden states of the steps before the first
+*changed one are those of the last pass. Resume finds that step by comparing
+*the input with the last one step by step, or takes it from the scan
+*positions the caller declared as changed, and restores the hidden states of
+*the steps before it. Both buffers are kept in the layout of the sweep.
+*/
+template <typename Dtype>
+class IRNNIncremental {
+ public:
+  IRNNIncremental() : valid_(false), hint_begin_(-1), hint_end_(-1) {}
+
+  // Declares that the input of the next pass only differs from the last
+  // one at the scan positions [begin, end), row or column indices along the
+  // scan axis, sparing the comparison.
+  void set_changed_positions(const int begin, const int end);
+
+  // h holds the new input. Returns the first step, in sweep order, that has
+  // to be computed, and copies the hidden states of the steps before it into
+  // h. The pass is only resumed if the weights are those of the last one.
+  int Resume(const IRNNSweep& sweep,
+      const vector<shared_ptr<Blob<Dtype> > >& weights, Dtype* h);
+  // Keeps the hidden states of the steps from first on, once h holds them.
+  void Store(const IRNNSweep& sweep, const int first, const Dtype* h);
+  // memory held by the last input and hidden states
+  size_t bytes() const { return (x_.count() + h_.count()) * sizeof(Dtype); }
+
+ protected:
+  bool valid_;      // x_ and h_ hold a whole pass
+  int hint_begin_;  // changed scan positions, or -1
+  int hint_end_;
+  IRNNSweep sweep_;
+  uint64_t weights_hash_;
+  Blob<Dtype> x_;   // the last input
+  Blob<Dtype> h_;   // the last hidden states
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IRNN_CACHE_HPP_
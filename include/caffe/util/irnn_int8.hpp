@@ -0,0 +1,83 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#ifndef CAFFE_UTIL_IRNN_INT8_HPP_
+#define CAFFE_UTIL_IRNN_INT8_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "caffe/blob.hpp"
+#include "caffe/util/irnn_math.hpp"
+
+namespace caffe {
+
+/**
+*@brief Int8 inference state of one IRNN direction.
+*
+*The hidden states are quantized to uint8 with one scale per channel, which
+*suits them as the ReLU keeps them non-negative. The scales come from the
+*largest hidden states met during the first float forward passes. The
+*recurrent weights are quantized to int8 per output channel, with the hidden
+*state scales folded in, so that a step accumulates w * h_prev in int32 and
+*requantizes h in its ReLU. The input and the top stay in float.
+*
+*The quantized hidden states are packed as [channels / 4][length][4], the
+*four channels of a scan line in one 32-bit word, which is what the u8 x s8
+*dot products of VNNI read.
+*/
+template <typename Dtype>
+class IRNNInt8 {
+ public:
+  IRNNInt8()
+      : channels_(0), words_(0), calibration_iter_(0), seen_(0),
+        h_q_data_(NULL) {}
+
+  void SetUp(const int channels, const int calibration_iter);
+  // Sizes the quantized hidden states for a sweep.
+  void Reshape(const IRNNSweep& sweep);
+
+  bool calibrated() const { return seen_ >= calibration_iter_; }
+  // Takes the hidden states h of a float forward pass into the scales.
+  void Calibrate(const IRNNSweep& sweep, const Dtype* h);
+  // Quantizes the float weights with the calibrated scales. Run it before
+  // every forward pass, the weights may be shared with a net in training,
+  // and before the slabs of the pass are handed out to threads.
+  void QuantizeWeights(const Dtype* w);
+
+  // irnn_forward_cpu on int8: h holds the input on entry and the hidden
+  // states on exit.
+  void Forward(const IRNNSweep& sweep, Dtype* h);
+  void Forward(const IRNNSweep& sweep, Dtype* h, const int slab,
+      const int slabs);
+
+ protected:
+  int channels_;
+  int words_;  // channels / 4, rounded up
+  int calibration_iter_;
+  int seen_;   // forward passes calibrated on so far
+  Blob<Dtype> h_max_;    // largest hidden state of each channel
+  Blob<Dtype> h_scale_;  // h = h_scale * uint8, per channel
+  Blob<Dtype> w_scale_;  // w * h_scale = w_scale * int8, per output channel
+  Blob<int> w_q_;        // channels x words, 4 int8 weights per word
+  Blob<int> w_q16_;      // the same as int16, 2 words per 4 weights
+  Blob<unsigned int> h_q_;  // previous and current step, 2 x words x length
+  uint8_t* h_q_data_;       // h_q_.mutable_cpu_data() of QuantizeWeights
+};
+
+// The instruction set of the u8 x s8 dot products of the int8 passes:
+// "avx512vnni", "avxvnni", "avx2" or "scalar", the widest the host runs.
+const char* irnn_int8_isa();
+// Makes the int8 passes use the dot products of isa instead, e.g. to test
+// them against "scalar". Returns false, and keeps the current ones, if the
+// build or the host lacks isa. Not to be called during a pass.
+bool irnn_int8_set_isa(const string& isa);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IRNN_INT8_HPP_
@@ -0,0 +1,350 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#ifndef CAFFE_UTIL_IRNN_MATH_HPP_
+#define CAFFE_UTIL_IRNN_MATH_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+namespace caffe {
+
+/**
+*@brief Memory layout of the hidden states visited by one IRNN sweep.
+*
+*The sweep runs for 'steps' steps. At each step it updates 'groups'
+*independent NH_ x 'length' matrices, whose rows are 'ld' elements apart.
+*Every column of such a matrix is one scan line (a column of the feature
+*map for up/down, a row for left/right).
+*
+*The CPU sweeps run 'tile' scan lines through all the steps before moving on
+*to the next ones, so that their hidden states are still in cache when the
+*next step reads them. The builders below set it to 'length', irnn_cpu_tile
+*picks a cache-sized one.
+*/
+struct IRNNSweep {
+  int steps;        // length of the scan axis
+  int groups;       // independent matrices per step, e.g. samples
+  int channels;     // NH_
+  int length;       // scan lines per matrix
+  int ld;           // leading dimension of each matrix
+  int step_stride;  // offset between two consecutive steps
+  int group_stride; // offset between two consecutive groups
+  bool reverse;     // sweep from the last step to the first one
+  int tile;         // scan lines taken through all the steps at a time
+};
+
+// Sweep along the third axis of a num*channels*height*width blob, one
+// group per sample. Consecutive samples are group_stride elements apart.
+IRNNSweep irnn_nchw_sweep(const int num, const int channels,
+    const int height, const int width, const int group_stride,
+    const bool reverse);
+
+// Sweep over a steps*channels*length blob, the layout the permute layers
+// produce for the directional layers. All steps form a single group.
+IRNNSweep irnn_step_major_sweep(const int steps, const int channels,
+    const int length, const bool reverse);
+
+// The part of a sweep from its step 'first' on, in sweep order, when the
+// steps before it already hold their hidden states. It starts one step
+// earlier, on the last valid hidden states, which its first ReLU leaves as
+// they are. The tail sweeps h + *offset; first 0 gives the whole sweep.
+IRNNSweep irnn_tail_sweep(const IRNNSweep& sweep, const int first,
+    int* offset);
+
+// The first 'steps' steps, in storage order, and the first 'length' scan
+// lines of one group of a sweep, as a sweep of h + *offset. A reverse sweep
+// then starts from step steps - 1, which serves the samples of a ragged
+// batch that do not span the whole map.
+IRNNSweep irnn_group_sweep(const IRNNSweep& sweep, const int group,
+    const int steps, const int length, int* offset);
+
+// Scan lines per tile such that the weights and the hidden states of a tile
+// at two consecutive steps fit in half of the L2 cache, at most length. When
+// the weights alone take that half, length: the sweep is not tiled.
+template <typename Dtype>
+int irnn_cpu_tile(const IRNNSweep& sweep);
+
+// One forward step, h = max(0, h + w * h_prev) for a channels x length
+// matrix h. The GEMM and the ReLU run together on column blocks of h while
+// they are in cache. h_prev may be NULL for the first step.
+template <typename Dtype>
+void irnn_step_cpu(const int channels, const int length, const int ld,
+    const Dtype* w, const Dtype* h_prev, Dtype* h);
+
+// h holds the input on entry and the hidden states on exit.
+template <typename Dtype>
+void irnn_forward_cpu(const IRNNSweep& sweep, const Dtype* w, Dtype* h);
+
+// Streams the recurrence backwards, one step at a time. The diff w.r.t. the
+// input is written to bottom_diff, which may be top_diff itself, and the
+// diff flowing between two steps is kept in carry, channels*length
+// elements. The weight diff is accumulated into w_diff once the chain is
+// done, with a single GEMM per group when its steps are adjacent in memory.
+template <typename Dtype>
+void irnn_backward_cpu(const IRNNSweep& sweep, const Dtype* w,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    Dtype* w_diff);
+
+// The scan lines of a sweep only share the weights, so its length columns
+// can be cut into slabs that workers sweep from the first step to the last
+// without waiting for each other. Slab k of n covers the columns
+// [k * length / n, (k + 1) * length / n) of every group.
+// irnn_forward_cpu and irnn_backward_cpu above spread the slabs over the
+// OpenMP threads themselves; the overloads below run a single slab, for
+// callers that schedule the slabs of several sweeps at once.
+
+// Threads available to the CPU sweeps, 1 without OpenMP.
+int irnn_cpu_workers();
+
+// Number of slabs to cut a sweep into for the given number of workers.
+int irnn_cpu_slabs(const IRNNSweep& sweep, const int workers);
+
+template <typename Dtype>
+void irnn_forward_cpu(const IRNNSweep& sweep, const Dtype* w, Dtype* h,
+    const int slab, const int slabs);
+
+// The dz chain of irnn_backward_cpu for one slab. The slabs use disjoint
+// columns of carry.
+template <typename Dtype>
+void irnn_backward_chain_cpu(const IRNNSweep& sweep, const Dtype* w,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    const int slab, const int slabs);
+
+// Accumulates the weight diff of a sweep into w_diff, given its hidden
+// states h and the dz left by its backward chain. When the steps of a
+// group lie side by side in its rows (step_stride == length and ld at least
+// steps * length) that is one GEMM per group. Otherwise it is one GEMM per
+// step: over the step-major layouts, and over the NCHW sweep of a ragged
+// sample narrower than the map, whose rows also hold the padding between
+// its steps. The padding of dz is not zeroed until after the sweep, so it
+// cannot be summed over.
+template <typename Dtype>
+void irnn_weight_diff_cpu(const IRNNSweep& sweep, const Dtype* h,
+    const Dtype* dz, Dtype* w_diff);
+
+// Low-rank recurrent weights w = I + u * v, with u channels x rank and v
+// rank x channels. A step then runs two GEMMs of rank x channels instead of
+// one of channels x channels. tmp, rank*length elements with rows 'length'
+// apart, holds v * h_prev in the forward pass and u^T * dz in the backward
+// one; the slabs use disjoint columns of it.
+
+// irnn_step_cpu for w = I + u * v, tmp rows being ldt elements apart.
+template <typename Dtype>
+void irnn_step_cpu(const int channels, const int rank, const int length,
+    const int ld, const Dtype* u, const Dtype* v, const Dtype* h_prev,
+    Dtype* h, Dtype* tmp, const int ldt);
+
+template <typename Dtype>
+void irnn_forward_cpu(const IRNNSweep& sweep, const int rank, const Dtype* u,
+    const Dtype* v, Dtype* h, Dtype* tmp, const int slab, const int slabs);
+
+template <typename Dtype>
+void irnn_forward_cpu(const IRNNSweep& sweep, const int rank, const Dtype* u,
+    const Dtype* v, Dtype* h, Dtype* tmp);
+
+template <typename Dtype>
+void irnn_backward_chain_cpu(const IRNNSweep& sweep, const int rank,
+    const Dtype* u, const Dtype* v, const Dtype* h, const Dtype* top_diff,
+    Dtype* bottom_diff, Dtype* carry, Dtype* tmp, const int slab,
+    const int slabs);
+
+// The diffs of u and v, accumulated from those of w one step at a time so
+// that no channels x channels product is formed.
+template <typename Dtype>
+void irnn_weight_diff_cpu(const IRNNSweep& sweep, const int rank,
+    const Dtype* u, const Dtype* v, const Dtype* h, const Dtype* dz,
+    Dtype* tmp, Dtype* u_diff, Dtype* v_diff);
+
+template <typename Dtype>
+void irnn_backward_cpu(const IRNNSweep& sweep, const int rank,
+    const Dtype* u, const Dtype* v, const Dtype* h, const Dtype* top_diff,
+    Dtype* bottom_diff, Dtype* carry, Dtype* tmp, Dtype* u_diff,
+    Dtype* v_diff);
+
+// Diagonal recurrent weights, w holding one weight per channel. A step is
+// then h = max(0, h + w .* h_prev) channel by channel, without any GEMM.
+template <typename Dtype>
+void irnn_diagonal_forward_cpu(const IRNNSweep& sweep, const Dtype* w,
+    Dtype* h, const int slab, const int slabs);
+
+template <typename Dtype>
+void irnn_diagonal_forward_cpu(const IRNNSweep& sweep, const Dtype* w,
+    Dtype* h);
+
+template <typename Dtype>
+void irnn_diagonal_backward_chain_cpu(const IRNNSweep& sweep,
+    const Dtype* w, const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff,
+    Dtype* carry, const int slab, const int slabs);
+
+template <typename Dtype>
+void irnn_diagonal_weight_diff_cpu(const IRNNSweep& sweep, const Dtype* h,
+    const Dtype* dz, Dtype* w_diff);
+
+template <typename Dtype>
+void irnn_diagonal_backward_cpu(const IRNNSweep& sweep, const Dtype* w,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    Dtype* w_diff);
+
+// Block-diagonal recurrent weights. The channels split into 'blocks'
+// independent blocks of channels / blocks, and w holds the square matrices
+// of the blocks one after another. Each block is swept on its own, so that
+// its matrix stays in cache through all the steps. irnn_block_sweep gives
+// the sweep of the first block; the others are channels / blocks rows
+// further down h, and carry.
+IRNNSweep irnn_block_sweep(const IRNNSweep& sweep, const int blocks);
+
+template <typename Dtype>
+void irnn_block_forward_cpu(const IRNNSweep& sweep, const int blocks,
+    const Dtype* w, Dtype* h);
+
+template <typename Dtype>
+void irnn_block_backward_cpu(const IRNNSweep& sweep, const int blocks,
+    const Dtype* w, const Dtype* h, const Dtype* top_diff,
+    Dtype* bottom_diff, Dtype* carry, Dtype* w_diff);
+
+// bfloat16, the upper half of a float. It keeps the range of float, so the
+// hidden states cannot overflow, with an 8-bit significand.
+typedef uint16_t irnn_bf16;
+
+inline irnn_bf16 irnn_to_bf16(const float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  // round to nearest even
+  bits += 0x7FFF + ((bits >> 16) & 1);
+  return static_cast<irnn_bf16>(bits >> 16);
+}
+
+inline float irnn_from_bf16(const irnn_bf16 x) {
+  const uint32_t bits = static_cast<uint32_t>(x) << 16;
+  float y;
+  memcpy(&y, &bits, sizeof(y));
+  return y;
+}
+
+// The backward pass on hidden states h and diffs stored in bf16, see
+// irnn_backward_cpu. diff holds dh on entry and dz on exit. The chain runs
+// in Dtype: dz_step, channels*length elements like carry, holds the dz of
+// the current step.
+template <typename Dtype>
+void irnn_backward_chain_cpu(const IRNNSweep& sweep, const Dtype* w,
+    const irnn_bf16* h, irnn_bf16* diff, Dtype* carry, Dtype* dz_step,
+    const int slab, const int slabs);
+
+// Elements of Dtype scratch irnn_weight_diff_cpu needs on bf16 data.
+int irnn_weight_diff_buffer(const IRNNSweep& sweep);
+
+// irnn_backward_cpu on bf16 data. buffer, the larger of channels*length
+// and irnn_weight_diff_buffer(sweep) elements, serves as dz_step and then
+// for irnn_weight_diff_cpu.
+template <typename Dtype>
+void irnn_backward_cpu(const IRNNSweep& sweep, const Dtype* w,
+    const irnn_bf16* h, irnn_bf16* diff, Dtype* carry, Dtype* buffer,
+    Dtype* w_diff);
+
+// irnn_weight_diff_cpu on bf16 data. Groups of steps are converted into
+// buffer, irnn_weight_diff_buffer(sweep) elements, for one GEMM each.
+template <typename Dtype>
+void irnn_weight_diff_cpu(const IRNNSweep& sweep, const irnn_bf16* h,
+    const irnn_bf16* dz, Dtype* buffer, Dtype* w_diff);
+
+// dst = bf16(src) for num*channels*height*width data, swapping the last two
+// axes if transpose is set. Samples are src_stride and dst_stride elements
+// apart.
+template <typename Dtype>
+void irnn_to_bf16_cpu(const int num, const int channels, const int height,
+    const int width, const bool transpose, const Dtype* src,
+    const int src_stride, irnn_bf16* dst, const int dst_stride);
+
+// The other way around, dst = src, or dst += src if accumulate is set.
+template <typename Dtype>
+void irnn_from_bf16_cpu(const int num, const int channels, const int height,
+    const int width, const bool transpose, const irnn_bf16* src,
+    const int src_stride, Dtype* dst, const int dst_stride,
+    const bool accumulate);
+
+/**
+*@brief Layout of a map that holds a ragged batch, padded to the largest
+*sample.
+*
+*Channel c of sample n at scan position s and position l along the scan
+*line sits at n * num_stride + c * channel_stride + s * step_stride +
+*l * line_stride. Sample n spans the first extent[2 * n] scan positions and
+*the first extent[2 * n + 1] positions along the scan lines.
+*/
+struct IRNNRaggedLayout {
+  int num;
+  int channels;
+  int steps;
+  int length;
+  int num_stride;
+  int channel_stride;
+  int step_stride;
+  int line_stride;
+};
+
+// Zeroes the padding of each sample of x, given the extents of the samples.
+template <typename Dtype>
+void irnn_ragged_mask_cpu(const IRNNRaggedLayout& layout, const int* extent,
+    Dtype* x);
+
+// Swaps the last two axes of num*channels*height*width data. Consecutive
+// samples are src_stride elements apart in src and dst_stride in dst.
+template <typename Dtype>
+void irnn_transpose_cpu(const int num, const int channels, const int height,
+    const int width, const Dtype* src, const int src_stride, Dtype* dst,
+    const int dst_stride);
+
+template <typename Dtype>
+void irnn_forward_gpu(const IRNNSweep& sweep, const Dtype* w, Dtype* h);
+
+template <typename Dtype>
+void irnn_backward_gpu(const IRNNSweep& sweep, const Dtype* w,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    Dtype* w_diff);
+
+template <typename Dtype>
+void irnn_forward_gpu(const IRNNSweep& sweep, const int rank, const Dtype* u,
+    const Dtype* v, Dtype* h, Dtype* tmp);
+
+template <typename Dtype>
+void irnn_backward_gpu(const IRNNSweep& sweep, const int rank,
+    const Dtype* u, const Dtype* v, const Dtype* h, const Dtype* top_diff,
+    Dtype* bottom_diff, Dtype* carry, Dtype* tmp, Dtype* u_diff,
+    Dtype* v_diff);
+
+template <typename Dtype>
+void irnn_diagonal_forward_gpu(const IRNNSweep& sweep, const Dtype* w,
+    Dtype* h);
+
+template <typename Dtype>
+void irnn_diagonal_backward_gpu(const IRNNSweep& sweep, const Dtype* w,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    Dtype* w_diff);
+
+template <typename Dtype>
+void irnn_block_forward_gpu(const IRNNSweep& sweep, const int blocks,
+    const Dtype* w, Dtype* h);
+
+template <typename Dtype>
+void irnn_block_backward_gpu(const IRNNSweep& sweep, const int blocks,
+    const Dtype* w, const Dtype* h, const Dtype* top_diff,
+    Dtype* bottom_diff, Dtype* carry, Dtype* w_diff);
+
+// extent in device memory
+template <typename Dtype>
+void irnn_ragged_mask_gpu(const IRNNRaggedLayout& layout, const int* extent,
+    Dtype* x);
+
+template <typename Dtype>
+void irnn_transpose_gpu(const int num, const int channels, const int height,
+    const int width, const Dtype* src, const int src_stride, Dtype* dst,
+    const int dst_stride);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IRNN_MATH_HPP_
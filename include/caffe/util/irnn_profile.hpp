@@ -0,0 +1,158 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#ifndef CAFFE_UTIL_IRNN_PROFILE_HPP_
+#define CAFFE_UTIL_IRNN_PROFILE_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#ifdef IRNN_PROFILE
+#include <time.h>
+#endif
+
+namespace caffe {
+
+/**
+*@brief Time and calls of the phases of the CPU passes of an IRNN layer,
+*and the high-water marks of its memory.
+*
+*Each directional layer owns one, see BaseIRNNLayer::profile(). It is only
+*filled when Caffe is built with IRNN_PROFILE defined (e.g. by adding
+*-DIRNN_PROFILE to COMMON_FLAGS in Makefile.config): otherwise the hooks
+*below compile to nothing and all the counters stay at zero.
+*
+*FORWARD and BACKWARD are the wall time of the passes. The other counters
+*are summed over the threads of the sweep, so that with OpenMP they may add
+*up to more than the wall time. The steps are timed whole rather than per
+*column block, so that the clock stays out of the inner loops. The diagonal
+*backward chain has no GEMM, its scaled carry counts as RELU_GRAD, and the
+*bf16 WEIGHT_DIFF includes the conversion of its operands. The int8
+*recurrence only shows in the pass times. The SpatialIRNN layer has no
+*profile.
+*/
+class IRNNProfile {
+ public:
+  enum Counter {
+    FORWARD,      // whole forward passes
+    BACKWARD,     // whole backward passes
+    COPY,         // bottom into the hidden states, top and diff into scratch
+    STEP,         // the forward steps, W * h_prev and the ReLU together
+    RELU_GRAD,    // dz = (top_diff + dh) * (h > 0)
+    CHAIN_GEMM,   // dh = W^T * dz, carried to the previous step
+    WEIGHT_DIFF,  // the GEMMs of the weight diff
+    BOTTOM_DIFF,  // dz into the bottom diff
+    NUM_COUNTERS
+  };
+  enum Watermark {
+    SCRATCH_BYTES, // workspace borrowed by a pass
+    CACHE_BYTES,   // kept for memoize and incremental
+    NUM_WATERMARKS
+  };
+
+  IRNNProfile() { Reset(); }
+  void Reset();
+
+  int64_t calls(const Counter counter) const { return calls_[counter]; }
+  double seconds(const Counter counter) const {
+    return nanoseconds_[counter] * 1e-9;
+  }
+  size_t high_water(const Watermark watermark) const {
+    return high_water_[watermark];
+  }
+  static const char* name(const Counter counter);
+  static const char* name(const Watermark watermark);
+
+  // Thread-safe, the sweeps report from their OpenMP threads.
+  void Add(const Counter counter, const int64_t nanoseconds);
+  void Raise(const Watermark watermark, const size_t bytes);
+  // One line per counter and watermark, for the log.
+  std::string Dump(const std::string& layer) const;
+
+  // The profile the kernels running on this thread report to, or NULL.
+  static IRNNProfile* current();
+  static void set_current(IRNNProfile* profile);
+
+ private:
+  int64_t calls_[NUM_COUNTERS];
+  int64_t nanoseconds_[NUM_COUNTERS];
+  size_t high_water_[NUM_WATERMARKS];
+};
+
+#ifdef IRNN_PROFILE
+
+// Makes profile the current one of this thread for its lifetime.
+class IRNNProfileScope {
+ public:
+  explicit IRNNProfileScope(IRNNProfile* profile)
+      : previous_(IRNNProfile::current()) {
+    IRNNProfile::set_current(profile);
+  }
+  ~IRNNProfileScope() { IRNNProfile::set_current(previous_); }
+
+ private:
+  IRNNProfile* previous_;
+};
+
+inline int64_t irnn_profile_clock() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// Adds its lifetime to a counter of the current profile, if there is one.
+class IRNNProfileTimer {
+ public:
+  explicit IRNNProfileTimer(const IRNNProfile::Counter counter)
+      : profile_(IRNNProfile::current()), counter_(counter),
+        start_(profile_ ? irnn_profile_clock() : 0) {}
+  ~IRNNProfileTimer() {
+    if (profile_) {
+      profile_->Add(counter_, irnn_profile_clock() - start_);
+    }
+  }
+
+ private:
+  IRNNProfile* profile_;
+  IRNNProfile::Counter counter_;
+  int64_t start_;
+};
+
+#define IRNN_PROFILE_NAME(name, line) name##line
+#define IRNN_PROFILE_UNIQUE(name, line) IRNN_PROFILE_NAME(name, line)
+
+// Reports the calls made within a layer pass to profile.
+#define IRNN_PROFILE_SCOPE(profile) \
+    IRNNProfileScope irnn_profile_scope_(profile)
+// Times the rest of the enclosing block as counter.
+#define IRNN_PROFILE_TIME(counter) \
+    IRNNProfileTimer IRNN_PROFILE_UNIQUE(irnn_profile_timer_, __LINE__)( \
+        IRNNProfile::counter)
+#define IRNN_PROFILE_RAISE(profile, watermark, bytes) \
+    (profile)->Raise(IRNNProfile::watermark, bytes)
+// Hands the current profile of the calling thread on to the threads of an
+// OpenMP loop: CAPTURE before the loop, ATTACH at the top of its body.
+#define IRNN_PROFILE_CAPTURE() \
+    IRNNProfile* const irnn_profile_ = IRNNProfile::current()
+#define IRNN_PROFILE_ATTACH() \
+    IRNNProfileScope irnn_profile_scope_(irnn_profile_)
+
+#else
+
+#define IRNN_PROFILE_SCOPE(profile)
+#define IRNN_PROFILE_TIME(counter)
+#define IRNN_PROFILE_RAISE(profile, watermark, bytes)
+#define IRNN_PROFILE_CAPTURE()
+#define IRNN_PROFILE_ATTACH()
+
+#endif  // IRNN_PROFILE
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IRNN_PROFILE_HPP_
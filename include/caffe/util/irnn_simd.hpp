@@ -0,0 +1,55 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#ifndef CAFFE_UTIL_IRNN_SIMD_HPP_
+#define CAFFE_UTIL_IRNN_SIMD_HPP_
+
+#include <string>
+
+namespace caffe {
+
+/**
+*@brief The elementwise parts of the CPU sweeps, on one row of n elements.
+*
+*Every step of a sweep runs one of these over each row of its tile right
+*after the GEMM that wrote it, while the row is still in L1, so each one
+*makes a single pass over its operands. The float versions use the widest
+*of AVX-512, AVX2 and SSE2 that the CPU supports, chosen once at run time,
+*so that a generic build still gets the wide vectors; the double versions
+*and the builds for other architectures run the scalar loops.
+*/
+
+// x = max(x, 0)
+template <typename Dtype>
+void irnn_relu_cpu(const int n, Dtype* x);
+
+// x = max(x + alpha * a, 0)
+template <typename Dtype>
+void irnn_axpy_relu_cpu(const int n, const Dtype alpha, const Dtype* a,
+    Dtype* x);
+
+// dz = (top_diff + carry) * (h > 0). dz may be top_diff.
+template <typename Dtype>
+void irnn_relu_grad_cpu(const int n, const Dtype* top_diff,
+    const Dtype* carry, const Dtype* h, Dtype* dz);
+
+// irnn_relu_grad_cpu, also setting carry to alpha * dz for the next step.
+template <typename Dtype>
+void irnn_relu_grad_scale_cpu(const int n, const Dtype alpha,
+    const Dtype* top_diff, Dtype* carry, const Dtype* h, Dtype* dz);
+
+// The instruction set of the float kernels: "avx512", "avx2", "sse2" or
+// "scalar".
+const char* irnn_simd_isa();
+// Makes the float kernels those of isa, e.g. to test them against
+// "scalar". Returns false, and keeps the current ones, if the build or the
+// host lacks isa. Not to be called during a pass.
+bool irnn_simd_set_isa(const std::string& isa);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IRNN_SIMD_HPP_
@@ -0,0 +1,69 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#ifndef CAFFE_UTIL_IRNN_WORKSPACE_HPP_
+#define CAFFE_UTIL_IRNN_WORKSPACE_HPP_
+
+#include <stddef.h>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+*@brief Scratch memory shared by the IRNN layers running on a thread.
+*
+*The layers of a net run one after the other on the thread of its solver,
+*and the CPU passes of the IRNN layers only need their scratch (transposed
+*hidden states, carried diffs) for the duration of a call. They borrow it
+*from the workspace of the calling thread instead of each keeping its own,
+*so that a net with several IRNN blocks holds the scratch of its largest
+*layer alone.
+*
+*The workspace grows to the largest request and never shrinks. Its memory is
+*aligned to a cache line and, with huge pages on, advised as transparent
+*huge pages on Linux. Like Caffe::Get(), Get() must not be called from
+*within an OpenMP region.
+*/
+class IRNNWorkspace {
+ public:
+  ~IRNNWorkspace();
+
+  // The workspace of the calling thread.
+  static IRNNWorkspace& Get();
+
+  // Alignment of the workspace and of the slices carved out of it.
+  static const size_t kAlign = 64;
+  static size_t Aligned(const size_t bytes) {
+    return (bytes + kAlign - 1) / kAlign * kAlign;
+  }
+
+  // Backs the memory allocated from now on by huge pages.
+  void set_huge_pages(const bool huge_pages) { huge_pages_ = huge_pages; }
+  bool huge_pages() const { return huge_pages_; }
+  size_t capacity() const { return capacity_; }
+
+  // At least bytes of scratch. The memory stays the caller's until it
+  // returns, the next Borrow on this thread may reuse it, and its content
+  // is undefined.
+  void* Borrow(const size_t bytes);
+  // Borrows n aligned slices at once, slice i of bytes[i] bytes.
+  void Borrow(const int n, const size_t* bytes, void** slices);
+
+ private:
+  IRNNWorkspace() : data_(NULL), capacity_(0), huge_pages_(false) {}
+
+  void* data_;
+  size_t capacity_;
+  bool huge_pages_;
+
+  DISABLE_COPY_AND_ASSIGN(IRNNWorkspace);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IRNN_WORKSPACE_HPP_
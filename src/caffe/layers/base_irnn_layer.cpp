@@ -0,0 +1,476 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/spatial_irnn_layer.hpp"
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/irnn_profile.hpp"
+#include "caffe/util/irnn_workspace.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes";
+  axis_ = bottom[0]->CanonicalAxisIndex(axis_);
+  if (axis_ == 1) {
+    // the old default, when the permuted layout was the only one
+    axis_ = 0;
+  }
+  const int scan_axis = horizontal_ ? 3 : 2;
+  CHECK(axis_ == 0 || axis_ == scan_axis) << this->type()
+      << " scans along axis 0 (or 1) of a permuted bottom or along axis "
+      << scan_axis << " of a 'N*C*H*W' bottom, got axis " << axis_;
+  transpose_ = horizontal_ && axis_ != 0;
+  if (bf16_storage_ && !transpose_) {
+    // the other layouts sweep the top itself, there is no copy to shrink
+    LOG(WARNING) << this->type() << " layer '" << this->layer_param_.name()
+        << "' ignores bf16_storage, which only applies to left and right on"
+        << " a 'N*C*H*W' bottom";
+  }
+
+  NX_ = bottom[0]->channels();
+  NH_ = NX_;
+  if (rank_ > 0) {
+    CHECK_LT(rank_, NH_) << "The rank must be below the channels, " << NH_;
+    CHECK(!bf16_storage_) << "bf16_storage needs dense recurrent weights";
+  }
+  if (diagonal_) {
+    CHECK_EQ(rank_, 0) << "A diagonal recurrence has no rank";
+    CHECK(!bf16_storage_) << "bf16_storage needs dense recurrent weights";
+    CHECK(!use_int8_) << "The diagonal recurrence has no GEMM to run in int8";
+  }
+  CHECK_GT(group_, 0);
+  CHECK_EQ(NH_ % group_, 0) << "The channels must split into " << group_
+      << " groups";
+  if (group_ > 1) {
+    CHECK(rank_ == 0 && !diagonal_)
+        << "Grouped weights are neither low-rank nor diagonal";
+    CHECK(!bf16_storage_) << "bf16_storage needs dense recurrent weights";
+  }
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else if (diagonal_) {
+    this->blobs_.resize(1);
+    this->blobs_[0].reset(new Blob<Dtype>(vector<int>(1, NH_)));
+    if (weight_filler_.type() == "identity") {
+      // the diagonal of the identity
+      caffe_set(NH_, Dtype(1.), this->blobs_[0]->mutable_cpu_data());
+    } else {
+      shared_ptr<Filler<Dtype> > weight_filler(
+          GetFiller<Dtype>(weight_filler_));
+      weight_filler->Fill(this->blobs_[0].get());
+    }
+  } else if (rank_ > 0) {
+    this->blobs_.resize(2);
+    vector<int> u_shape(2);
+    u_shape[0] = NH_;
+    u_shape[1] = rank_;
+    vector<int> v_shape(2);
+    v_shape[0] = rank_;
+    v_shape[1] = NH_;
+    this->blobs_[0].reset(new Blob<Dtype>(u_shape));
+    this->blobs_[1].reset(new Blob<Dtype>(v_shape));
+    if (weight_filler_.type() == "identity") {
+      // W starts as the identity, with U = 0, and V random so that U
+      // receives gradients
+      caffe_set(this->blobs_[0]->count(), Dtype(0.),
+          this->blobs_[0]->mutable_cpu_data());
+      caffe_rng_gaussian<Dtype>(this->blobs_[1]->count(), Dtype(0.),
+          Dtype(1.) / std::sqrt(Dtype(NH_)),
+          this->blobs_[1]->mutable_cpu_data());
+    } else {
+      shared_ptr<Filler<Dtype> > weight_filler(
+          GetFiller<Dtype>(weight_filler_));
+      weight_filler->Fill(this->blobs_[0].get());
+      weight_filler->Fill(this->blobs_[1].get());
+    }
+  } else {
+    this->blobs_.resize(1);
+    vector<int> w_shape(2);
+    w_shape[0] = NH_;
+    w_shape[1] = NH_ / group_;
+    this->blobs_[0].reset(new Blob<Dtype>(w_shape));
+    shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(weight_filler_));
+    weight_filler->Fill(this->blobs_[0].get());
+  }
+  CHECK_EQ(this->blobs_.size(), rank_ > 0 ? 2u : 1u)
+      << "The weights do not match the rank " << rank_;
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  if (use_int8_) {
+    int8_.SetUp(NH_, int8_calibration_iter_);
+  }
+  if (bottom.size() > 1) {
+    CHECK(!memoize_ && !incremental_)
+        << "memoize and incremental take a single bottom";
+  }
+  cache_.SetUp(memoize_);
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(NX_, bottom[0]->channels())
+      << "Input channels must match the recurrent weights";
+  if (axis_ == 0 && horizontal_) {
+    // bottom data's shape is 'W*C*H*N'
+    W_ = bottom[0]->num();
+    H_ = bottom[0]->height();
+    N_ = bottom[0]->width();
+    sweep_ = irnn_step_major_sweep(W_, NH_, H_ * N_, reverse_);
+  } else if (axis_ == 0) {
+    // bottom data's shape is 'H*C*N*W'
+    H_ = bottom[0]->num();
+    N_ = bottom[0]->height();
+    W_ = bottom[0]->width();
+    sweep_ = irnn_step_major_sweep(H_, NH_, N_ * W_, reverse_);
+  } else {
+    // bottom data's shape is 'N*C*H*W', left/right run on its transpose
+    N_ = bottom[0]->num();
+    H_ = bottom[0]->height();
+    W_ = bottom[0]->width();
+    sweep_ = horizontal_ ?
+        irnn_nchw_sweep(N_, NH_, W_, H_, NH_ * H_ * W_, reverse_) :
+        irnn_nchw_sweep(N_, NH_, H_, W_, NH_ * H_ * W_, reverse_);
+  }
+  sweep_.tile = irnn_cpu_tile<Dtype>(sweep_);
+  sweeps_.assign(1, sweep_);
+  sweep_offsets_.assign(1, 0);
+  if (bottom.size() > 1) {
+    CHECK_EQ(2 * N_, bottom[1]->count())
+        << "The sizes must hold the height and width of each sample";
+    IRNNRaggedLayout& layout = ragged_layout_;
+    layout.num = N_;
+    layout.channels = NH_;
+    layout.steps = horizontal_ ? W_ : H_;
+    layout.length = horizontal_ ? H_ : W_;
+    if (axis_ == 0 && horizontal_) {
+      layout.num_stride = 1;
+      layout.channel_stride = H_ * N_;
+      layout.line_stride = N_;
+    } else if (axis_ == 0) {
+      layout.num_stride = W_;
+      layout.channel_stride = N_ * W_;
+      layout.line_stride = 1;
+    } else {
+      layout.num_stride = NH_ * H_ * W_;
+      layout.channel_stride = H_ * W_;
+      layout.line_stride = horizontal_ ? W_ : 1;
+    }
+    layout.step_stride = axis_ == 0 ? NH_ * layout.channel_stride :
+        (horizontal_ ? 1 : W_);
+    extent_.Reshape(vector<int>(1, 2 * N_));
+  }
+  if (use_int8_) {
+    int8_.Reshape(sweep_);
+  }
+
+  vector<int> top_shape = bottom[0]->shape();
+  if (transpose_) {
+    trans_.Reshape(top_shape);
+  }
+
+  ReshapeHH();
+  top[0]->Reshape(top_shape);
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  IRNN_PROFILE_SCOPE(&profile_);
+  IRNN_PROFILE_TIME(FORWARD);
+  const bool int8 = use_int8_ && this->phase_ == TEST;
+  // the int8 calibration passes have to see every input
+  const bool cached = !int8 || int8_.calibrated();
+  if (cached && cache_.Restore(*bottom[0], this->blobs_, top[0])) {
+    return;
+  }
+  const bool ragged = bottom.size() > 1;
+  if (ragged) {
+    RaggedSweeps(*bottom[1]);
+  }
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const int count = top[0]->count();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int dim = NH_ * H_ * W_;
+  Dtype* scratch[4];
+  BorrowScratch(false, scratch);
+
+  // the sweep runs in place on h, which is the bottom itself when the layer
+  // runs in place
+  Dtype* h = top_data;
+  if (transpose_) {
+    IRNN_PROFILE_TIME(COPY);
+    h = scratch[0];
+    irnn_transpose_cpu(N_, NH_, H_, W_, bottom_data, dim, h, dim);
+  } else if (top[0] != bottom[0]) {
+    IRNN_PROFILE_TIME(COPY);
+    caffe_copy(count, bottom_data, h);
+  }
+  if (ragged && !transpose_) {
+    // zero input keeps the padding at zero through the steps a sample
+    // shares with longer ones
+    irnn_ragged_mask_cpu(ragged_layout_, extent_.cpu_data(), h);
+  }
+  // with incremental set, the steps before the first changed one keep the
+  // hidden states of the last pass and the sweep resumes from there
+  int first = 0;
+  if (incremental_ && cached) {
+    first = last_pass_.Resume(sweep_, this->blobs_, h);
+  }
+  const bool quantized = int8 && int8_.calibrated();
+  if (quantized) {
+    int8_.QuantizeWeights(rank_ > 0 || group_ > 1 ? DenseWeights() :
+        this->blobs_[0]->cpu_data());
+  }
+  for (int i = 0; i < sweeps_.size(); ++i) {
+    int offset;
+    const IRNNSweep sweep = irnn_tail_sweep(sweeps_[i], first, &offset);
+    ForwardSweep_cpu(sweep, quantized, h + sweep_offsets_[i] + offset,
+        scratch[2]);
+  }
+  if (int8 && !quantized) {
+    int8_.Calibrate(sweep_, h);
+  }
+  if (incremental_ && cached) {
+    last_pass_.Store(sweep_, first, h);
+  }
+  if (transpose_) {
+    IRNN_PROFILE_TIME(COPY);
+    irnn_transpose_cpu(N_, NH_, W_, H_, h, dim, top_data, dim);
+  }
+  if (ragged && (transpose_ || axis_ == 0)) {
+    // the input left in the padding of the transpose, or the steps past a
+    // sample shorter than the shared sweep
+    irnn_ragged_mask_cpu(ragged_layout_, extent_.cpu_data(), top_data);
+  }
+  if (cached) {
+    cache_.Store(*top[0]);
+    // the top of memoize and the last pass of incremental
+    IRNN_PROFILE_RAISE(&profile_, CACHE_BYTES,
+        cache_.bytes() + last_pass_.bytes());
+  }
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  IRNN_PROFILE_SCOPE(&profile_);
+  IRNN_PROFILE_TIME(BACKWARD);
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* top_data = top[0]->cpu_data();
+  const int dim = NH_ * H_ * W_;
+  Dtype* scratch[4];
+  BorrowScratch(true, scratch);
+  Dtype* hh_data = scratch[2];
+  // dh flowing from one step to the next
+  Dtype* hh_diff = scratch[3];
+
+  if (transpose_ && bf16_storage_) {
+    // the bf16 hidden states and diffs take the space of trans_.data alone
+    irnn_bf16* h = reinterpret_cast<irnn_bf16*>(scratch[0]);
+    irnn_bf16* diff = h + trans_.count();
+    {
+      IRNN_PROFILE_TIME(COPY);
+      irnn_to_bf16_cpu(N_, NH_, H_, W_, true, top_data, dim, h, dim);
+      irnn_to_bf16_cpu(N_, NH_, H_, W_, true, top_diff, dim, diff, dim);
+    }
+    for (int i = 0; i < sweeps_.size(); ++i) {
+      const int offset = sweep_offsets_[i];
+      irnn_backward_cpu(sweeps_[i], this->blobs_[0]->cpu_data(), h + offset,
+          diff + offset, hh_diff, hh_data,
+          this->blobs_[0]->mutable_cpu_diff());
+    }
+    if (propagate_down[0]) {
+      IRNN_PROFILE_TIME(BOTTOM_DIFF);
+      irnn_from_bf16_cpu(N_, NH_, W_, H_, true, diff, dim,
+          bottom[0]->mutable_cpu_diff(), dim, false);
+    }
+  } else if (transpose_) {
+    Dtype* trans_data = scratch[0];
+    Dtype* trans_diff = scratch[1];
+    {
+      IRNN_PROFILE_TIME(COPY);
+      irnn_transpose_cpu(N_, NH_, H_, W_, top_data, dim, trans_data, dim);
+      irnn_transpose_cpu(N_, NH_, H_, W_, top_diff, dim, trans_diff, dim);
+    }
+    // dz replaces the transposed top diff in place
+    for (int i = 0; i < sweeps_.size(); ++i) {
+      const int offset = sweep_offsets_[i];
+      BackwardSweep_cpu(sweeps_[i], trans_data + offset, trans_diff + offset,
+          trans_diff + offset, hh_diff, hh_data);
+    }
+    if (propagate_down[0]) {
+      IRNN_PROFILE_TIME(BOTTOM_DIFF);
+      irnn_transpose_cpu(N_, NH_, W_, H_, trans_diff, dim,
+          bottom[0]->mutable_cpu_diff(), dim);
+    }
+  } else {
+    // dz is written straight to the bottom diff, which also carries the
+    // chain when propagate_down[0] is not set
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    for (int i = 0; i < sweeps_.size(); ++i) {
+      const int offset = sweep_offsets_[i];
+      BackwardSweep_cpu(sweeps_[i], top_data + offset, top_diff + offset,
+          bottom_diff + offset, hh_diff, hh_data);
+    }
+  }
+  if (bottom.size() > 1 && propagate_down[0]) {
+    // the sweeps leave the padding, or only write zero to it
+    IRNN_PROFILE_TIME(BOTTOM_DIFF);
+    irnn_ragged_mask_cpu(ragged_layout_, extent_.cpu_data(),
+        bottom[0]->mutable_cpu_diff());
+  }
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::ForwardSweep_cpu(const IRNNSweep& sweep,
+    const bool quantized, Dtype* h, Dtype* tmp) {
+  const Dtype* w = this->blobs_[0]->cpu_data();
+  if (quantized) {
+    int8_.Forward(sweep, h);
+  } else if (diagonal_) {
+    irnn_diagonal_forward_cpu(sweep, w, h);
+  } else if (rank_ > 0) {
+    irnn_forward_cpu(sweep, rank_, w, this->blobs_[1]->cpu_data(), h, tmp);
+  } else if (group_ > 1) {
+    irnn_block_forward_cpu(sweep, group_, w, h);
+  } else {
+    irnn_forward_cpu(sweep, w, h);
+  }
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::BackwardSweep_cpu(const IRNNSweep& sweep,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    Dtype* tmp) {
+  const Dtype* w = this->blobs_[0]->cpu_data();
+  Dtype* w_diff = this->blobs_[0]->mutable_cpu_diff();
+  if (diagonal_) {
+    irnn_diagonal_backward_cpu(sweep, w, h, top_diff, bottom_diff, carry,
+        w_diff);
+  } else if (rank_ > 0) {
+    irnn_backward_cpu(sweep, rank_, w, this->blobs_[1]->cpu_data(), h,
+        top_diff, bottom_diff, carry, tmp, w_diff,
+        this->blobs_[1]->mutable_cpu_diff());
+  } else if (group_ > 1) {
+    irnn_block_backward_cpu(sweep, group_, w, h, top_diff, bottom_diff,
+        carry, w_diff);
+  } else {
+    irnn_backward_cpu(sweep, w, h, top_diff, bottom_diff, carry, w_diff);
+  }
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::BorrowScratch(const bool backward,
+    Dtype** scratch) {
+  // one step of the sweep, for the carried diff and the low-rank tmp; hh_
+  // is only wider than that for the buffer of the bf16 backward pass
+  const size_t step = NH_ * sweep_.length * sizeof(Dtype);
+  size_t bytes[4];
+  bytes[0] = trans_.count() * sizeof(Dtype);
+  // the bf16 hidden states and diffs both fit in trans_.data
+  bytes[1] = backward && !(transpose_ && bf16_storage_) ? bytes[0] : 0;
+  bytes[2] = backward ? hh_.count() * sizeof(Dtype) : step;
+  bytes[3] = backward ? step : 0;
+  IRNNWorkspace::Get().Borrow(4, bytes, reinterpret_cast<void**>(scratch));
+  IRNN_PROFILE_RAISE(&profile_, SCRATCH_BYTES,
+      bytes[0] + bytes[1] + bytes[2] + bytes[3]);
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::RaggedSweeps(const Blob<Dtype>& sizes) {
+  const Dtype* size = sizes.cpu_data();
+  int* extent = extent_.mutable_cpu_data();
+  int steps = 0;
+  for (int n = 0; n < N_; ++n) {
+    const int height = static_cast<int>(size[2 * n]);
+    const int width = static_cast<int>(size[2 * n + 1]);
+    CHECK(height >= 0 && height <= H_ && width >= 0 && width <= W_)
+        << "Sample " << n << " of " << height << "x" << width
+        << " does not fit the " << H_ << "x" << W_ << " map";
+    extent[2 * n] = horizontal_ ? width : height;
+    extent[2 * n + 1] = horizontal_ ? height : width;
+    steps = std::max(steps, extent[2 * n]);
+  }
+  sweeps_.clear();
+  sweep_offsets_.clear();
+  int offset;
+  if (axis_ == 0) {
+    // the scan lines of all the samples share the GEMM of each step, up to
+    // the longest sample
+    if (steps > 0) {
+      sweeps_.push_back(irnn_group_sweep(sweep_, 0, steps, sweep_.length,
+          &offset));
+      sweep_offsets_.push_back(offset);
+    }
+  } else {
+    for (int n = 0; n < N_; ++n) {
+      if (extent[2 * n] > 0 && extent[2 * n + 1] > 0) {
+        sweeps_.push_back(irnn_group_sweep(sweep_, n, extent[2 * n],
+            extent[2 * n + 1], &offset));
+        sweep_offsets_.push_back(offset);
+      }
+    }
+  }
+  // a sample with shorter scan lines converts more steps at a time in the
+  // bf16 weight diff, which may take more than the full sweep
+  ReshapeHH();
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::ReshapeHH() {
+  vector<int> hh_shape(2);
+  hh_shape[0] = NH_;
+  hh_shape[1] = sweep_.length;
+  if (transpose_ && bf16_storage_) {
+    // hh_.data is the Dtype scratch of the bf16 backward pass
+    for (int i = 0; i < sweeps_.size(); ++i) {
+      hh_shape[1] = std::max(hh_shape[1],
+          irnn_weight_diff_buffer(sweeps_[i]) / NH_);
+    }
+  }
+  hh_.Reshape(hh_shape);
+}
+
+template <typename Dtype>
+const Dtype* BaseIRNNLayer<Dtype>::DenseWeights() {
+  vector<int> w_shape(2, NH_);
+  dense_w_.Reshape(w_shape);
+  Dtype* w = dense_w_.mutable_cpu_data();
+  if (rank_ > 0) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, NH_, NH_, rank_,
+        Dtype(1.), this->blobs_[0]->cpu_data(), this->blobs_[1]->cpu_data(),
+        Dtype(0.), w);
+    for (int c = 0; c < NH_; ++c) {
+      w[c * NH_ + c] += Dtype(1.);
+    }
+    return w;
+  }
+  // the block of channel c starts at column c / NB * NB
+  const int NB = NH_ / group_;
+  const Dtype* blocks = this->blobs_[0]->cpu_data();
+  caffe_set(NH_ * NH_, Dtype(0.), w);
+  for (int c = 0; c < NH_; ++c) {
+    caffe_copy(NB, blocks + c * NB, w + c * NH_ + c / NB * NB);
+  }
+  return w;
+}
+
+#ifdef CPU_ONLY
+STUB_GPU(BaseIRNNLayer);
+#endif
+
+INSTANTIATE_CLASS(BaseIRNNLayer);
+
+}  // namespace caffe
@@ -0,0 +1,137 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <vector>
+
+#include "caffe/layers/spatial_irnn_layer.hpp"
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (use_int8_ && this->phase_ == TEST) {
+    // the int8 sweep only exists on the CPU
+    Forward_cpu(bottom, top);
+    return;
+  }
+  if (cache_.Restore(*bottom[0], this->blobs_, top[0])) {
+    return;
+  }
+  const bool ragged = bottom.size() > 1;
+  if (ragged) {
+    RaggedSweeps(*bottom[1]);
+  }
+  const Dtype* bottom_data = bottom[0]->gpu_data();
+  const int count = top[0]->count();
+  Dtype* top_data = top[0]->mutable_gpu_data();
+
+  // the sweep runs in place on h, which is the bottom itself when the layer
+  // runs in place
+  Dtype* h = top_data;
+  const int dim = NH_ * H_ * W_;
+  if (transpose_) {
+    h = trans_.mutable_gpu_data();
+    irnn_transpose_gpu(N_, NH_, H_, W_, bottom_data, dim, h, dim);
+  } else if (top[0] != bottom[0]) {
+    caffe_copy(count, bottom_data, h);
+  }
+  if (ragged && !transpose_) {
+    irnn_ragged_mask_gpu(ragged_layout_, extent_.gpu_data(), h);
+  }
+  for (int i = 0; i < sweeps_.size(); ++i) {
+    ForwardSweep_gpu(sweeps_[i], h + sweep_offsets_[i]);
+  }
+  if (transpose_) {
+    irnn_transpose_gpu(N_, NH_, W_, H_, h, dim, top_data, dim);
+  }
+  if (ragged && (transpose_ || axis_ == 0)) {
+    irnn_ragged_mask_gpu(ragged_layout_, extent_.gpu_data(), top_data);
+  }
+  cache_.Store(*top[0]);
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  const Dtype* top_diff = top[0]->gpu_diff();
+  const Dtype* top_data = top[0]->gpu_data();
+
+  if (transpose_) {
+    const int dim = NH_ * H_ * W_;
+    Dtype* trans_data = trans_.mutable_gpu_data();
+    Dtype* trans_diff = trans_.mutable_gpu_diff();
+    irnn_transpose_gpu(N_, NH_, H_, W_, top_data, dim, trans_data, dim);
+    irnn_transpose_gpu(N_, NH_, H_, W_, top_diff, dim, trans_diff, dim);
+    // dz replaces the transposed top diff in place
+    for (int i = 0; i < sweeps_.size(); ++i) {
+      const int offset = sweep_offsets_[i];
+      BackwardSweep_gpu(sweeps_[i], trans_data + offset, trans_diff + offset,
+          trans_diff + offset);
+    }
+    if (propagate_down[0]) {
+      irnn_transpose_gpu(N_, NH_, W_, H_, trans_diff, dim,
+          bottom[0]->mutable_gpu_diff(), dim);
+    }
+  } else {
+    // dz is written straight to the bottom diff, which also carries the
+    // chain when propagate_down[0] is not set
+    Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
+    for (int i = 0; i < sweeps_.size(); ++i) {
+      const int offset = sweep_offsets_[i];
+      BackwardSweep_gpu(sweeps_[i], top_data + offset, top_diff + offset,
+          bottom_diff + offset);
+    }
+  }
+  if (bottom.size() > 1 && propagate_down[0]) {
+    irnn_ragged_mask_gpu(ragged_layout_, extent_.gpu_data(),
+        bottom[0]->mutable_gpu_diff());
+  }
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::ForwardSweep_gpu(const IRNNSweep& sweep,
+    Dtype* h) {
+  const Dtype* w = this->blobs_[0]->gpu_data();
+  if (diagonal_) {
+    irnn_diagonal_forward_gpu(sweep, w, h);
+  } else if (rank_ > 0) {
+    irnn_forward_gpu(sweep, rank_, w, this->blobs_[1]->gpu_data(), h,
+        hh_.mutable_gpu_data());
+  } else if (group_ > 1) {
+    irnn_block_forward_gpu(sweep, group_, w, h);
+  } else {
+    irnn_forward_gpu(sweep, w, h);
+  }
+}
+
+template <typename Dtype>
+void BaseIRNNLayer<Dtype>::BackwardSweep_gpu(const IRNNSweep& sweep,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff) {
+  const Dtype* w = this->blobs_[0]->gpu_data();
+  Dtype* w_diff = this->blobs_[0]->mutable_gpu_diff();
+  // dh flowing from one step to the next
+  Dtype* hh_diff = hh_.mutable_gpu_diff();
+  if (diagonal_) {
+    irnn_diagonal_backward_gpu(sweep, w, h, top_diff, bottom_diff, hh_diff,
+        w_diff);
+  } else if (rank_ > 0) {
+    irnn_backward_gpu(sweep, rank_, w, this->blobs_[1]->gpu_data(), h,
+        top_diff, bottom_diff, hh_diff, hh_.mutable_gpu_data(), w_diff,
+        this->blobs_[1]->mutable_gpu_diff());
+  } else if (group_ > 1) {
+    irnn_block_backward_gpu(sweep, group_, w, h, top_diff, bottom_diff,
+        hh_diff, w_diff);
+  } else {
+    irnn_backward_gpu(sweep, w, h, top_diff, bottom_diff, hh_diff, w_diff);
+  }
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(BaseIRNNLayer);
+}  // namespace caffe
@@ -0,0 +1,541 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/spatial_irnn_layer.hpp"
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/irnn_workspace.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Directions are stored in the order of the concat in
+// models/example.prototxt: left, right, down, up. Left and right run over
+// the transposed map, left and up sweep backwards.
+static inline bool IsHorizontal(const int d) { return d < 2; }
+static inline bool IsReverse(const int d) { return d == 0 || d == 3; }
+
+template <typename Dtype>
+static shared_ptr<Blob<Dtype> > FilledBlob(const vector<int>& shape,
+    const FillerParameter& filler_param) {
+  shared_ptr<Blob<Dtype> > blob(new Blob<Dtype>(shape));
+  shared_ptr<Filler<Dtype> > filler(GetFiller<Dtype>(filler_param));
+  filler->Fill(blob.get());
+  return blob;
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  // bottom data's shape is 'N*C*H*W'
+  CHECK_NE(top[0], bottom[0]) << this->type() << " cannot run in place, "
+      << "it reads its bottom after writing its top";
+  const SpatialIRNNParameter& param = this->layer_param_.spatial_irnn_param();
+  NX_ = bottom[0]->channels();
+  project_input_ = param.num_hidden() > 0;
+  NH_ = project_input_ ? param.num_hidden() : NX_;
+  input_bias_term_ = project_input_ && param.input_bias_term();
+  num_output_ = param.num_output();
+  bias_term_ = num_output_ > 0 && param.bias_term();
+  // the recurrent weights, the output projection and its bias, then the
+  // input projection and its bias
+  input_blob_ = 4 + (num_output_ > 0) + bias_term_;
+  const int num_blobs = input_blob_ + project_input_ + input_bias_term_;
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    this->blobs_.resize(num_blobs);
+    vector<int> w_shape(2);
+    w_shape[0] = NH_;
+    w_shape[1] = NH_;
+    for (int d = 0; d < 4; ++d) {
+      this->blobs_[d] = FilledBlob<Dtype>(w_shape, param.weight_filler());
+    }
+    // The projections are shaped as the weights of the 1x1 convolutions
+    // they replace, so that these can be copied over.
+    vector<int> p_shape(4, 1);
+    if (num_output_ > 0) {
+      p_shape[0] = num_output_;
+      p_shape[1] = 4 * NH_;
+      this->blobs_[4] = FilledBlob<Dtype>(p_shape,
+          param.projection_filler());
+    }
+    if (bias_term_) {
+      this->blobs_[5] = FilledBlob<Dtype>(vector<int>(1, num_output_),
+          param.bias_filler());
+    }
+    if (project_input_) {
+      p_shape[0] = NH_;
+      p_shape[1] = NX_;
+      this->blobs_[input_blob_] = FilledBlob<Dtype>(p_shape,
+          param.input_filler());
+    }
+    if (input_bias_term_) {
+      this->blobs_[input_blob_ + 1] = FilledBlob<Dtype>(
+          vector<int>(1, NH_), param.input_bias_filler());
+    }
+  }
+  CHECK_EQ(this->blobs_.size(), num_blobs) << "Incorrect number of weight "
+      << "blobs for num_output, bias_term, num_hidden and input_bias_term";
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  use_int8_ = param.int8();
+  bf16_storage_ = param.bf16_storage();
+  if (use_int8_) {
+    for (int d = 0; d < 4; ++d) {
+      int8_[d].SetUp(NH_, param.int8_calibration_iter());
+    }
+  }
+  cache_.SetUp(param.memoize());
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
+      << "corresponding to (num, channels, height, width)";
+  CHECK_EQ(NX_, bottom[0]->channels())
+      << "Input channels must match the weights";
+  N_ = bottom[0]->num();
+  H_ = bottom[0]->height();
+  W_ = bottom[0]->width();
+
+  vector<int> top_shape = bottom[0]->shape();
+  top_shape[1] = 4 * NH_;
+  if (num_output_ > 0) {
+    // Only allocated once touched: by the TRAIN phase, and on the GPU.
+    hidden_.Reshape(top_shape);
+    top_shape[1] = num_output_;
+  }
+  top[0]->Reshape(top_shape);
+  if (bias_term_ || input_bias_term_) {
+    vector<int> multiplier_shape(1, H_ * W_);
+    bias_multiplier_.Reshape(multiplier_shape);
+    caffe_set(H_ * W_, Dtype(1), bias_multiplier_.mutable_cpu_data());
+  }
+  // a direction's input, hidden states and diffs
+  vector<int> direction_shape = bottom[0]->shape();
+  direction_shape[1] = NH_;
+  if (project_input_) {
+    // only its diff on the GPU
+    projected_.Reshape(direction_shape);
+  }
+
+  const int dim = NH_ * H_ * W_;
+  for (int d = 0; d < 4; ++d) {
+    sweep_[d] = IsHorizontal(d) ?
+        irnn_nchw_sweep(N_, NH_, W_, H_, dim, IsReverse(d)) :
+        irnn_nchw_sweep(N_, NH_, H_, W_, 4 * dim, IsReverse(d));
+    sweep_[d].tile = irnn_cpu_tile<Dtype>(sweep_[d]);
+    if (use_int8_) {
+      int8_[d].Reshape(sweep_[d]);
+    }
+  }
+
+  vector<int> hh_shape(2);
+  hh_shape[0] = NH_;
+  hh_shape[1] = std::max(H_, W_);
+  if (bf16_storage_) {
+    // hh_.data is the Dtype scratch of the bf16 backward pass of left and
+    // right
+    for (int d = 0; d < 2; ++d) {
+      hh_shape[1] = std::max(hh_shape[1],
+          irnn_weight_diff_buffer(sweep_[d]) / NH_);
+    }
+  }
+  if (trans_.size() == 0) {
+    for (int d = 0; d < 4; ++d) {
+      trans_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      hh_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    }
+  }
+  for (int d = 0; d < 4; ++d) {
+    trans_[d]->Reshape(direction_shape);
+    hh_[d]->Reshape(hh_shape);
+  }
+}
+
+// The sweeps of the four directions are cut into slabs, which are numbered
+// one direction after the other: direction d owns the tasks
+// [first[d], first[d + 1]). The workers are shared out between the four.
+static void PlanSlabs(const IRNNSweep* sweeps, int* slabs, int* first) {
+  const int workers = (irnn_cpu_workers() + 3) / 4;
+  first[0] = 0;
+  for (int d = 0; d < 4; ++d) {
+    slabs[d] = irnn_cpu_slabs(sweeps[d], workers);
+    first[d + 1] = first[d] + slabs[d];
+  }
+}
+
+static inline int TaskDirection(const int* first, const int task) {
+  int d = 0;
+  while (task >= first[d + 1]) {
+    ++d;
+  }
+  return d;
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const bool int8 = use_int8_ && this->phase_ == TEST;
+  const bool quantized = int8 && int8_[0].calibrated();
+  // the int8 calibration passes have to see every input
+  const bool cached = !int8 || quantized;
+  if (cached && cache_.Restore(*bottom[0], this->blobs_, top[0])) {
+    return;
+  }
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int dim = NH_ * H_ * W_;
+  Dtype* scratch[17];
+  BorrowScratch(false, scratch);
+  // With num_output the directions fill the concat, not the top.
+  Dtype* hidden_data = top_data;
+  if (num_output_ > 0) {
+    hidden_data = this->phase_ == TRAIN ? hidden_.mutable_cpu_data() :
+        scratch[16];
+  }
+  // The input of the recurrence is the bottom, or with num_hidden its
+  // projection, computed straight into the slice of up in the concat.
+  const Dtype* input = bottom[0]->cpu_data();
+  int input_stride = dim;
+  if (project_input_) {
+    ForwardInput_cpu(input, hidden_data + 3 * dim);
+    input = hidden_data + 3 * dim;
+    input_stride = 4 * dim;
+  }
+
+  const Dtype* w[4];
+  Dtype* h[4];
+  for (int d = 0; d < 4; ++d) {
+    w[d] = this->blobs_[d]->cpu_data();
+    if (IsHorizontal(d)) {
+      h[d] = scratch[4 * d];
+      irnn_transpose_cpu(N_, NH_, H_, W_, input, input_stride, h[d], dim);
+    } else {
+      // nothing to copy for up when the input is projected
+      h[d] = hidden_data + d * dim;
+      for (int n = 0; n < N_; ++n) {
+        caffe_copy(dim, input + n * input_stride, h[d] + n * 4 * dim);
+      }
+    }
+  }
+
+  if (quantized) {
+    for (int d = 0; d < 4; ++d) {
+      int8_[d].QuantizeWeights(w[d]);
+    }
+  }
+
+  // Every slab of every direction runs its whole sweep on one thread. No
+  // Caffe call may happen in here, Caffe::Get() is per thread.
+  int slabs[4];
+  int first[5];
+  PlanSlabs(sweep_, slabs, first);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (int task = 0; task < first[4]; ++task) {
+    const int d = TaskDirection(first, task);
+    if (quantized) {
+      int8_[d].Forward(sweep_[d], h[d], task - first[d], slabs[d]);
+    } else {
+      irnn_forward_cpu(sweep_[d], w[d], h[d], task - first[d], slabs[d]);
+    }
+  }
+  if (int8 && !quantized) {
+    for (int d = 0; d < 4; ++d) {
+      int8_[d].Calibrate(sweep_[d], h[d]);
+    }
+  }
+
+  for (int d = 0; d < 2; ++d) {
+    irnn_transpose_cpu(N_, NH_, W_, H_, h[d], dim, hidden_data + d * dim,
+        4 * dim);
+  }
+  if (num_output_ > 0) {
+    ForwardProjection_cpu(hidden_data, top_data);
+  }
+  if (cached) {
+    cache_.Store(*top[0]);
+  }
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  // The sweeps start from the concat of the four directions and its diff,
+  // which with num_output are those of hidden_.
+  const Dtype* top_data = top[0]->cpu_data();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  if (num_output_ > 0) {
+    BackwardProjection_cpu(top_diff);
+    top_data = hidden_.cpu_data();
+    top_diff = hidden_.cpu_diff();
+  }
+  Dtype* scratch[17];
+  BorrowScratch(true, scratch);
+  // dz of the four directions sums up to the diff of the input of the
+  // recurrence, which the input projection needs even without
+  // propagate_down
+  Dtype* input_diff = NULL;
+  if (project_input_) {
+    input_diff = scratch[16];
+  } else if (propagate_down[0]) {
+    input_diff = bottom[0]->mutable_cpu_diff();
+  }
+  BackwardSweeps_cpu(top_data, top_diff, scratch, input_diff);
+  if (project_input_) {
+    BackwardInput_cpu(input_diff, propagate_down, bottom);
+  }
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::BackwardSweeps_cpu(const Dtype* top_data,
+    const Dtype* top_diff, Dtype** scratch, Dtype* input_diff) {
+  const int count = N_ * NH_ * H_ * W_;
+  const int dim = NH_ * H_ * W_;
+
+  // Each direction replaces a copy of dh in place by dz. Left and right
+  // sweep a transposed copy of their hidden states too, with bf16_storage
+  // in bf16 along with dh in the space of the Dtype copy. Up and down read
+  // theirs from the concat, which takes no more than a bf16 copy would. A
+  // sweep takes the same offsets in h and in dh, but the concat holds a
+  // sample every 4 * dim elements where the copy of dh holds one every dim,
+  // so up and down sweep one sample at a time.
+  const Dtype* w[4];
+  const Dtype* h_data[4];
+  Dtype* h_diff[4];
+  irnn_bf16* h_bf16[2];
+  irnn_bf16* diff_bf16[2];
+  Dtype* carry[4];
+  for (int d = 0; d < 4; ++d) {
+    w[d] = this->blobs_[d]->cpu_data();
+    h_diff[d] = scratch[4 * d + 1];
+    carry[d] = scratch[4 * d + 3];
+    if (IsHorizontal(d) && bf16_storage_) {
+      h_bf16[d] = reinterpret_cast<irnn_bf16*>(scratch[4 * d]);
+      diff_bf16[d] = h_bf16[d] + trans_[d]->count();
+      irnn_to_bf16_cpu(N_, NH_, H_, W_, true, top_data + d * dim, 4 * dim,
+          h_bf16[d], dim);
+      irnn_to_bf16_cpu(N_, NH_, H_, W_, true, top_diff + d * dim, 4 * dim,
+          diff_bf16[d], dim);
+    } else if (IsHorizontal(d)) {
+      irnn_transpose_cpu(N_, NH_, H_, W_, top_data + d * dim, 4 * dim,
+          scratch[4 * d], dim);
+      irnn_transpose_cpu(N_, NH_, H_, W_, top_diff + d * dim, 4 * dim,
+          h_diff[d], dim);
+      h_data[d] = scratch[4 * d];
+    } else {
+      for (int n = 0; n < N_; ++n) {
+        caffe_copy(dim, top_diff + n * 4 * dim + d * dim, h_diff[d] + n * dim);
+      }
+      h_data[d] = top_data + d * dim;
+    }
+  }
+
+  int slabs[4];
+  int first[5];
+  PlanSlabs(sweep_, slabs, first);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (int task = 0; task < first[4]; ++task) {
+    const int d = TaskDirection(first, task);
+    const int slab = task - first[d];
+    if (IsHorizontal(d) && bf16_storage_) {
+      irnn_backward_chain_cpu(sweep_[d], w[d], h_bf16[d], diff_bf16[d],
+          carry[d], scratch[4 * d + 2], slab, slabs[d]);
+    } else if (IsHorizontal(d)) {
+      irnn_backward_chain_cpu(sweep_[d], w[d], h_data[d], h_diff[d],
+          h_diff[d], carry[d], slab, slabs[d]);
+    } else {
+      // the slab owns the same scan lines of every sample, as in the sweep
+      // over all of them
+      for (int n = 0; n < N_; ++n) {
+        int offset;
+        const IRNNSweep sample = irnn_group_sweep(sweep_[d], n, H_, W_,
+            &offset);
+        Dtype* dz = h_diff[d] + n * dim;
+        irnn_backward_chain_cpu(sample, w[d], h_data[d] + offset, dz, dz,
+            carry[d], slab, slabs[d]);
+      }
+    }
+  }
+
+  // The weight diffs and the input diff are summed in a fixed order, so
+  // they do not depend on how the slabs were scheduled.
+  for (int d = 0; d < 4; ++d) {
+    Dtype* w_diff = this->blobs_[d]->mutable_cpu_diff();
+    if (IsHorizontal(d) && bf16_storage_) {
+      irnn_weight_diff_cpu(sweep_[d], h_bf16[d], diff_bf16[d],
+          scratch[4 * d + 2], w_diff);
+      if (input_diff) {
+        irnn_from_bf16_cpu(N_, NH_, W_, H_, true, diff_bf16[d], dim,
+            input_diff, dim, d > 0);
+      }
+      continue;
+    }
+    if (IsHorizontal(d)) {
+      irnn_weight_diff_cpu(sweep_[d], h_data[d], h_diff[d], w_diff);
+    } else {
+      for (int n = 0; n < N_; ++n) {
+        int offset;
+        const IRNNSweep sample = irnn_group_sweep(sweep_[d], n, H_, W_,
+            &offset);
+        irnn_weight_diff_cpu(sample, h_data[d] + offset, h_diff[d] + n * dim,
+            w_diff);
+      }
+    }
+    if (!input_diff) {
+      continue;
+    }
+    const Dtype* dz = h_diff[d];
+    if (IsHorizontal(d)) {
+      // over the transposed hidden states, which are no longer needed
+      irnn_transpose_cpu(N_, NH_, W_, H_, h_diff[d], dim, scratch[4 * d],
+          dim);
+      dz = scratch[4 * d];
+    }
+    if (d == 0) {
+      caffe_copy(count, dz, input_diff);
+    } else {
+      caffe_axpy(count, Dtype(1.), dz, input_diff);
+    }
+  }
+}
+
+// The 1x1 convolution over the concat is a single GEMM per sample: the
+// four directions are the K = 4C rows of one matrix, so that their
+// contributions are summed inside the GEMM.
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::ForwardProjection_cpu(const Dtype* hidden,
+    Dtype* top) {
+  const int spatial = H_ * W_;
+  const Dtype* weight = this->blobs_[4]->cpu_data();
+  for (int n = 0; n < N_; ++n) {
+    Dtype* top_n = top + n * num_output_ * spatial;
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_, spatial,
+        4 * NH_, (Dtype)1., weight, hidden + n * 4 * NH_ * spatial,
+        (Dtype)0., top_n);
+    if (bias_term_) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_, spatial,
+          1, (Dtype)1., this->blobs_[5]->cpu_data(),
+          bias_multiplier_.cpu_data(), (Dtype)1., top_n);
+    }
+  }
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::BackwardProjection_cpu(const Dtype* top_diff) {
+  const int spatial = H_ * W_;
+  const Dtype* weight = this->blobs_[4]->cpu_data();
+  const Dtype* hidden_data = hidden_.cpu_data();
+  Dtype* hidden_diff = hidden_.mutable_cpu_diff();
+  for (int n = 0; n < N_; ++n) {
+    const Dtype* top_diff_n = top_diff + n * num_output_ * spatial;
+    const int offset = n * 4 * NH_ * spatial;
+    if (this->param_propagate_down_[4]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num_output_, 4 * NH_,
+          spatial, (Dtype)1., top_diff_n, hidden_data + offset, (Dtype)1.,
+          this->blobs_[4]->mutable_cpu_diff());
+    }
+    if (bias_term_ && this->param_propagate_down_[5]) {
+      caffe_cpu_gemv<Dtype>(CblasNoTrans, num_output_, spatial, (Dtype)1.,
+          top_diff_n, bias_multiplier_.cpu_data(), (Dtype)1.,
+          this->blobs_[5]->mutable_cpu_diff());
+    }
+    // the recurrent weights always need the diff of the concat
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, 4 * NH_, spatial,
+        num_output_, (Dtype)1., weight, top_diff_n, (Dtype)0.,
+        hidden_diff + offset);
+  }
+}
+
+// The 1x1 convolution in front of the directions, NH x NX, as one GEMM per
+// sample whose result lands at the stride of the concat.
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::ForwardInput_cpu(const Dtype* bottom,
+    Dtype* input) {
+  const int spatial = H_ * W_;
+  const Dtype* weight = this->blobs_[input_blob_]->cpu_data();
+  for (int n = 0; n < N_; ++n) {
+    Dtype* input_n = input + n * 4 * NH_ * spatial;
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, NH_, spatial, NX_,
+        (Dtype)1., weight, bottom + n * NX_ * spatial, (Dtype)0., input_n);
+    if (input_bias_term_) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, NH_, spatial, 1,
+          (Dtype)1., this->blobs_[input_blob_ + 1]->cpu_data(),
+          bias_multiplier_.cpu_data(), (Dtype)1., input_n);
+    }
+  }
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::BackwardInput_cpu(const Dtype* input_diff,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  const int spatial = H_ * W_;
+  const Dtype* weight = this->blobs_[input_blob_]->cpu_data();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  for (int n = 0; n < N_; ++n) {
+    const Dtype* input_diff_n = input_diff + n * NH_ * spatial;
+    if (this->param_propagate_down_[input_blob_]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, NH_, NX_, spatial,
+          (Dtype)1., input_diff_n, bottom_data + n * NX_ * spatial,
+          (Dtype)1., this->blobs_[input_blob_]->mutable_cpu_diff());
+    }
+    if (input_bias_term_ && this->param_propagate_down_[input_blob_ + 1]) {
+      caffe_cpu_gemv<Dtype>(CblasNoTrans, NH_, spatial, (Dtype)1.,
+          input_diff_n, bias_multiplier_.cpu_data(), (Dtype)1.,
+          this->blobs_[input_blob_ + 1]->mutable_cpu_diff());
+    }
+    if (propagate_down[0]) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, NX_, spatial, NH_,
+          (Dtype)1., weight, input_diff_n, (Dtype)0.,
+          bottom[0]->mutable_cpu_diff() + n * NX_ * spatial);
+    }
+  }
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::BorrowScratch(const bool backward,
+    Dtype** scratch) {
+  size_t bytes[17];
+  for (int d = 0; d < 4; ++d) {
+    const size_t trans = trans_[d]->count() * sizeof(Dtype);
+    const size_t hh = hh_[d]->count() * sizeof(Dtype);
+    const size_t step = NH_ * sweep_[d].length * sizeof(Dtype);
+    // up and down read their hidden states from the concat; with
+    // bf16_storage left and right fit theirs and dh in the data, and hh_.data
+    // is the buffer of their weight diff, the float sweeps only carry a step
+    const bool bf16 = bf16_storage_ && IsHorizontal(d);
+    bytes[4 * d] = IsHorizontal(d) ? trans : 0;
+    bytes[4 * d + 1] = backward && !bf16 ? trans : 0;
+    bytes[4 * d + 2] = backward && bf16 ? hh : 0;
+    bytes[4 * d + 3] = backward ? step : 0;
+  }
+  // the TEST phase does not keep the concat for a backward pass, and the
+  // backward pass sums up the diff of the projected input
+  if (backward) {
+    bytes[16] = project_input_ ? projected_.count() * sizeof(Dtype) : 0;
+  } else {
+    const bool concat = num_output_ > 0 && this->phase_ != TRAIN;
+    bytes[16] = concat ? hidden_.count() * sizeof(Dtype) : 0;
+  }
+  IRNNWorkspace::Get().Borrow(17, bytes, reinterpret_cast<void**>(scratch));
+}
+
+#ifdef CPU_ONLY
+STUB_GPU(SpatialIRNNLayer);
+#endif
+
+INSTANTIATE_CLASS(SpatialIRNNLayer);
+REGISTER_LAYER_CLASS(SpatialIRNN);
+
+}  // namespace caffe
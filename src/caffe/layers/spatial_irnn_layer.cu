@@ -0,0 +1,221 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <vector>
+
+#include "caffe/layers/spatial_irnn_layer.hpp"
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+static inline bool IsHorizontal(const int d) { return d < 2; }
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (use_int8_ && this->phase_ == TEST) {
+    // the int8 sweep only exists on the CPU
+    Forward_cpu(bottom, top);
+    return;
+  }
+  if (cache_.Restore(*bottom[0], this->blobs_, top[0])) {
+    return;
+  }
+  Dtype* top_data = top[0]->mutable_gpu_data();
+  const int dim = NH_ * H_ * W_;
+  // With num_output the directions fill the concat, not the top.
+  Dtype* hidden_data = num_output_ > 0 ? hidden_.mutable_gpu_data() :
+      top_data;
+  // with num_hidden the projected input, in the slice of up, which is
+  // swept last
+  const Dtype* input = bottom[0]->gpu_data();
+  int input_stride = dim;
+  if (project_input_) {
+    ForwardInput_gpu(input, hidden_data + 3 * dim);
+    input = hidden_data + 3 * dim;
+    input_stride = 4 * dim;
+  }
+
+  for (int d = 0; d < 4; ++d) {
+    const Dtype* w = this->blobs_[d]->gpu_data();
+    Dtype* hidden_slice = hidden_data + d * dim;
+    if (IsHorizontal(d)) {
+      // the directions run one after another, see Backward_gpu
+      Dtype* trans_data = trans_[0]->mutable_gpu_data();
+      irnn_transpose_gpu(N_, NH_, H_, W_, input, input_stride, trans_data,
+          dim);
+      irnn_forward_gpu(sweep_[d], w, trans_data);
+      irnn_transpose_gpu(N_, NH_, W_, H_, trans_data, dim, hidden_slice,
+          4 * dim);
+    } else {
+      for (int n = 0; n < N_; ++n) {
+        caffe_copy(dim, input + n * input_stride,
+            hidden_slice + n * 4 * dim);
+      }
+      irnn_forward_gpu(sweep_[d], w, hidden_slice);
+    }
+  }
+  if (num_output_ > 0) {
+    ForwardProjection_gpu(hidden_data, top_data);
+  }
+  cache_.Store(*top[0]);
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  // The sweeps start from the concat and its diff, as in Backward_cpu.
+  const Dtype* top_data = top[0]->gpu_data();
+  const Dtype* top_diff = top[0]->gpu_diff();
+  if (num_output_ > 0) {
+    BackwardProjection_gpu(top_diff);
+    top_data = hidden_.gpu_data();
+    top_diff = hidden_.gpu_diff();
+  }
+  const int count = N_ * NH_ * H_ * W_;
+  const int dim = NH_ * H_ * W_;
+
+  // The directions run one after another on the GPU and share the scratch
+  // of the first one: its hidden states and dh, then dz in place of dh.
+  Dtype* h_data = trans_[0]->mutable_gpu_data();
+  Dtype* h_diff = trans_[0]->mutable_gpu_diff();
+
+  Dtype* hh_diff = hh_[0]->mutable_gpu_diff();
+
+  // the sum of dz, the diff of the projected input with num_hidden
+  Dtype* input_diff = NULL;
+  if (project_input_) {
+    input_diff = projected_.mutable_gpu_diff();
+  } else if (propagate_down[0]) {
+    input_diff = bottom[0]->mutable_gpu_diff();
+  }
+  if (input_diff) {
+    caffe_gpu_set(count, Dtype(0.), input_diff);
+  }
+
+  for (int d = 0; d < 4; ++d) {
+    const Dtype* w = this->blobs_[d]->gpu_data();
+    Dtype* w_diff = this->blobs_[d]->mutable_gpu_diff();
+    if (IsHorizontal(d)) {
+      irnn_transpose_gpu(N_, NH_, H_, W_, top_data + d * dim, 4 * dim,
+          h_data, dim);
+      irnn_transpose_gpu(N_, NH_, H_, W_, top_diff + d * dim, 4 * dim,
+          h_diff, dim);
+      irnn_backward_gpu(sweep_[d], w, h_data, h_diff, h_diff, hh_diff,
+          w_diff);
+      if (input_diff) {
+        irnn_transpose_gpu(N_, NH_, W_, H_, h_diff, dim, h_data, dim);
+        caffe_gpu_axpy(count, Dtype(1.), h_data, input_diff);
+      }
+    } else {
+      for (int n = 0; n < N_; ++n) {
+        caffe_copy(dim, top_data + n * 4 * dim + d * dim, h_data + n * dim);
+        caffe_copy(dim, top_diff + n * 4 * dim + d * dim, h_diff + n * dim);
+      }
+      // the copy is compact, unlike the top
+      IRNNSweep sweep = sweep_[d];
+      sweep.group_stride = dim;
+      irnn_backward_gpu(sweep, w, h_data, h_diff, h_diff, hh_diff, w_diff);
+      if (input_diff) {
+        caffe_gpu_axpy(count, Dtype(1.), h_diff, input_diff);
+      }
+    }
+  }
+  if (project_input_) {
+    BackwardInput_gpu(input_diff, propagate_down, bottom);
+  }
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::ForwardProjection_gpu(const Dtype* hidden,
+    Dtype* top) {
+  const int spatial = H_ * W_;
+  const Dtype* weight = this->blobs_[4]->gpu_data();
+  for (int n = 0; n < N_; ++n) {
+    Dtype* top_n = top + n * num_output_ * spatial;
+    caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_, spatial,
+        4 * NH_, (Dtype)1., weight, hidden + n * 4 * NH_ * spatial,
+        (Dtype)0., top_n);
+    if (bias_term_) {
+      caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_, spatial,
+          1, (Dtype)1., this->blobs_[5]->gpu_data(),
+          bias_multiplier_.gpu_data(), (Dtype)1., top_n);
+    }
+  }
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::BackwardProjection_gpu(const Dtype* top_diff) {
+  const int spatial = H_ * W_;
+  const Dtype* weight = this->blobs_[4]->gpu_data();
+  const Dtype* hidden_data = hidden_.gpu_data();
+  Dtype* hidden_diff = hidden_.mutable_gpu_diff();
+  for (int n = 0; n < N_; ++n) {
+    const Dtype* top_diff_n = top_diff + n * num_output_ * spatial;
+    const int offset = n * 4 * NH_ * spatial;
+    if (this->param_propagate_down_[4]) {
+      caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num_output_, 4 * NH_,
+          spatial, (Dtype)1., top_diff_n, hidden_data + offset, (Dtype)1.,
+          this->blobs_[4]->mutable_gpu_diff());
+    }
+    if (bias_term_ && this->param_propagate_down_[5]) {
+      caffe_gpu_gemv<Dtype>(CblasNoTrans, num_output_, spatial, (Dtype)1.,
+          top_diff_n, bias_multiplier_.gpu_data(), (Dtype)1.,
+          this->blobs_[5]->mutable_gpu_diff());
+    }
+    caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, 4 * NH_, spatial,
+        num_output_, (Dtype)1., weight, top_diff_n, (Dtype)0.,
+        hidden_diff + offset);
+  }
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::ForwardInput_gpu(const Dtype* bottom,
+    Dtype* input) {
+  const int spatial = H_ * W_;
+  const Dtype* weight = this->blobs_[input_blob_]->gpu_data();
+  for (int n = 0; n < N_; ++n) {
+    Dtype* input_n = input + n * 4 * NH_ * spatial;
+    caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, NH_, spatial, NX_,
+        (Dtype)1., weight, bottom + n * NX_ * spatial, (Dtype)0., input_n);
+    if (input_bias_term_) {
+      caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, NH_, spatial, 1,
+          (Dtype)1., this->blobs_[input_blob_ + 1]->gpu_data(),
+          bias_multiplier_.gpu_data(), (Dtype)1., input_n);
+    }
+  }
+}
+
+template <typename Dtype>
+void SpatialIRNNLayer<Dtype>::BackwardInput_gpu(const Dtype* input_diff,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  const int spatial = H_ * W_;
+  const Dtype* weight = this->blobs_[input_blob_]->gpu_data();
+  const Dtype* bottom_data = bottom[0]->gpu_data();
+  for (int n = 0; n < N_; ++n) {
+    const Dtype* input_diff_n = input_diff + n * NH_ * spatial;
+    if (this->param_propagate_down_[input_blob_]) {
+      caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, NH_, NX_, spatial,
+          (Dtype)1., input_diff_n, bottom_data + n * NX_ * spatial,
+          (Dtype)1., this->blobs_[input_blob_]->mutable_gpu_diff());
+    }
+    if (input_bias_term_ && this->param_propagate_down_[input_blob_ + 1]) {
+      caffe_gpu_gemv<Dtype>(CblasNoTrans, NH_, spatial, (Dtype)1.,
+          input_diff_n, bias_multiplier_.gpu_data(), (Dtype)1.,
+          this->blobs_[input_blob_ + 1]->mutable_gpu_diff());
+    }
+    if (propagate_down[0]) {
+      caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, NX_, spatial, NH_,
+          (Dtype)1., weight, input_diff_n, (Dtype)0.,
+          bottom[0]->mutable_gpu_diff() + n * NX_ * spatial);
+    }
+  }
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(SpatialIRNNLayer);
+}  // namespace caffe
@@ -0,0 +1,1157 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/spatial_irnn_layer.hpp"
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/irnn_workspace.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+enum IRNNDirection { IRNN_UP, IRNN_DOWN, IRNN_LEFT, IRNN_RIGHT };
+
+template <typename TypeParam>
+class DirectionalIRNNLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  DirectionalIRNNLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 4, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~DirectionalIRNNLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  // Gives the bottom num x channels x height x width uniform values.
+  void ReshapeBottom(const int num, const int channels, const int height,
+      const int width) {
+    this->blob_bottom_->Reshape(num, channels, height, width);
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+  }
+
+  static bool IsHorizontal(const IRNNDirection direction) {
+    return direction == IRNN_LEFT || direction == IRNN_RIGHT;
+  }
+
+  static LayerParameter IRNNParam(const IRNNDirection direction,
+      const int axis, const FillerParameter& weight_filler) {
+    LayerParameter param;
+    switch (direction) {
+    case IRNN_UP:
+      param.mutable_rnn_up_param()->set_axis(axis);
+      param.mutable_rnn_up_param()->mutable_weight_filler()->CopyFrom(
+          weight_filler);
+      break;
+    case IRNN_DOWN:
+      param.mutable_rnn_down_param()->set_axis(axis);
+      param.mutable_rnn_down_param()->mutable_weight_filler()->CopyFrom(
+          weight_filler);
+      break;
+    case IRNN_LEFT:
+      param.mutable_rnn_left_param()->set_axis(axis);
+      param.mutable_rnn_left_param()->mutable_weight_filler()->CopyFrom(
+          weight_filler);
+      break;
+    case IRNN_RIGHT:
+      param.mutable_rnn_right_param()->set_axis(axis);
+      param.mutable_rnn_right_param()->mutable_weight_filler()->CopyFrom(
+          weight_filler);
+      break;
+    }
+    return param;
+  }
+
+  // The RNN*Parameter of direction in param.
+  static google::protobuf::Message* DirectionParam(
+      const IRNNDirection direction, LayerParameter* param) {
+    switch (direction) {
+    case IRNN_UP:
+      return param->mutable_rnn_up_param();
+    case IRNN_DOWN:
+      return param->mutable_rnn_down_param();
+    case IRNN_LEFT:
+      return param->mutable_rnn_left_param();
+    default:
+      return param->mutable_rnn_right_param();
+    }
+  }
+
+  // IRNNParam with options, in text format, merged into the parameter of
+  // the direction, e.g. "rank: 2 incremental: true".
+  static LayerParameter IRNNParam(const IRNNDirection direction,
+      const int axis, const FillerParameter& weight_filler,
+      const string& options) {
+    LayerParameter param = IRNNParam(direction, axis, weight_filler);
+    CHECK(google::protobuf::TextFormat::MergeFromString(options,
+        DirectionParam(direction, &param))) << options;
+    return param;
+  }
+
+  static shared_ptr<Layer<Dtype> > NewLayer(const IRNNDirection direction,
+      const LayerParameter& param) {
+    switch (direction) {
+    case IRNN_UP:
+      return shared_ptr<Layer<Dtype> >(new RNNUPLayer<Dtype>(param));
+    case IRNN_DOWN:
+      return shared_ptr<Layer<Dtype> >(new RNNDOWNLayer<Dtype>(param));
+    case IRNN_LEFT:
+      return shared_ptr<Layer<Dtype> >(new RNNLEFTLayer<Dtype>(param));
+    default:
+      return shared_ptr<Layer<Dtype> >(new RNNRIGHTLayer<Dtype>(param));
+    }
+  }
+
+  // Offset of (n, c, h, w) in the layout the layers take with axis 0:
+  // 'H*C*N*W' for up/down and 'W*C*H*N' for left/right, as the SSD permute
+  // layers produce it.
+  static int PermutedOffset(const IRNNDirection direction, const int N,
+      const int C, const int H, const int W, const int n, const int c,
+      const int h, const int w) {
+    return IsHorizontal(direction) ? ((w * C + c) * H + h) * N + n :
+        ((h * C + c) * N + n) * W + w;
+  }
+
+  static void Permute(const IRNNDirection direction, const Blob<Dtype>& nchw,
+      Blob<Dtype>* permuted) {
+    const int N = nchw.num();
+    const int C = nchw.channels();
+    const int H = nchw.height();
+    const int W = nchw.width();
+    if (IsHorizontal(direction)) {
+      permuted->Reshape(W, C, H, N);
+    } else {
+      permuted->Reshape(H, C, N, W);
+    }
+    for (int n = 0; n < N; ++n) {
+      for (int c = 0; c < C; ++c) {
+        for (int h = 0; h < H; ++h) {
+          for (int w = 0; w < W; ++w) {
+            permuted->mutable_cpu_data()[PermutedOffset(direction, N, C, H, W,
+                n, c, h, w)] = nchw.data_at(n, c, h, w);
+          }
+        }
+      }
+    }
+  }
+
+  // Sets x of the N*C*H*W blob at the row (up/down) or column (left/right)
+  // position of the map to uniform values in [-1, 1].
+  static void FillPosition(const IRNNDirection direction, const int position,
+      Blob<Dtype>* x) {
+    Blob<Dtype> values(x->shape());
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(&values);
+    for (int n = 0; n < x->num(); ++n) {
+      for (int c = 0; c < x->channels(); ++c) {
+        for (int l = 0; l < (IsHorizontal(direction) ? x->height() :
+            x->width()); ++l) {
+          const int offset = IsHorizontal(direction) ?
+              x->offset(n, c, l, position) : x->offset(n, c, position, l);
+          x->mutable_cpu_data()[offset] = values.cpu_data()[offset];
+        }
+      }
+    }
+  }
+
+  static void ExpectBlobsNear(const Blob<Dtype>& expected,
+      const Blob<Dtype>& actual, const bool diff, const Dtype tolerance) {
+    ASSERT_EQ(expected.count(), actual.count());
+    const Dtype* expected_data = diff ? expected.cpu_diff() :
+        expected.cpu_data();
+    const Dtype* actual_data = diff ? actual.cpu_diff() : actual.cpu_data();
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected_data[i], actual_data[i], tolerance) << i;
+    }
+  }
+
+  // h = max(0, x + W * h_prev) along the direction, on a N*C*H*W blob.
+  static void Reference(const IRNNDirection direction,
+      const Blob<Dtype>& bottom, const Dtype* weights, Blob<Dtype>* top) {
+    const int N = bottom.num();
+    const int C = bottom.channels();
+    const int H = bottom.height();
+    const int W = bottom.width();
+    const bool horizontal = IsHorizontal(direction);
+    const bool reverse = direction == IRNN_UP || direction == IRNN_LEFT;
+    const int steps = horizontal ? W : H;
+    const int lines = horizontal ? H : W;
+    top->ReshapeLike(bottom);
+    Dtype* h = top->mutable_cpu_data();
+    for (int n = 0; n < N; ++n) {
+      for (int l = 0; l < lines; ++l) {
+        for (int s = 0; s < steps; ++s) {
+          const int i = reverse ? steps - 1 - s : s;
+          const int prev = reverse ? i + 1 : i - 1;
+          for (int c = 0; c < C; ++c) {
+            Dtype z = horizontal ? bottom.data_at(n, c, l, i) :
+                bottom.data_at(n, c, i, l);
+            for (int k = 0; s > 0 && k < C; ++k) {
+              z += weights[c * C + k] * (horizontal ?
+                  h[top->offset(n, k, l, prev)] :
+                  h[top->offset(n, k, prev, l)]);
+            }
+            h[horizontal ? top->offset(n, c, l, i) :
+                top->offset(n, c, i, l)] = std::max(z, Dtype(0.));
+          }
+        }
+      }
+    }
+  }
+
+  // The N*C*H*W layer against the reference, and the permuted layouts,
+  // axis 0 and its alias 1, against the N*C*H*W layer.
+  void TestForward(const IRNNDirection direction) {
+    FillerParameter weight_filler;
+    weight_filler.set_type("gaussian");
+    weight_filler.set_std(0.3);
+    const int axis = IsHorizontal(direction) ? 3 : 2;
+    shared_ptr<Layer<Dtype> > layer =
+        NewLayer(direction, IRNNParam(direction, axis, weight_filler));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> expected;
+    Reference(direction, *this->blob_bottom_, layer->blobs()[0]->cpu_data(),
+        &expected);
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], top_data[i], 1e-4);
+    }
+
+    const int N = this->blob_bottom_->num();
+    const int C = this->blob_bottom_->channels();
+    const int H = this->blob_bottom_->height();
+    const int W = this->blob_bottom_->width();
+    Blob<Dtype> permuted_bottom;
+    Permute(direction, *this->blob_bottom_, &permuted_bottom);
+    for (int permuted_axis = 0; permuted_axis < 2; ++permuted_axis) {
+      Blob<Dtype> permuted_top;
+      vector<Blob<Dtype>*> bottom_vec(1, &permuted_bottom);
+      vector<Blob<Dtype>*> top_vec(1, &permuted_top);
+      shared_ptr<Layer<Dtype> > permuted_layer = NewLayer(direction,
+          IRNNParam(direction, permuted_axis, weight_filler));
+      permuted_layer->blobs().push_back(layer->blobs()[0]);
+      permuted_layer->SetUp(bottom_vec, top_vec);
+      permuted_layer->Forward(bottom_vec, top_vec);
+      for (int n = 0; n < N; ++n) {
+        for (int c = 0; c < C; ++c) {
+          for (int h = 0; h < H; ++h) {
+            for (int w = 0; w < W; ++w) {
+              EXPECT_NEAR(this->blob_top_->data_at(n, c, h, w),
+                  permuted_top.cpu_data()[PermutedOffset(direction, N, C, H,
+                  W, n, c, h, w)], 1e-4);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  void TestGradient(const IRNNDirection direction, const bool permuted,
+      const string& options = "") {
+    // Inputs at least 1/3 away from zero and weights small enough that
+    // W * h_prev stays below that keep every pre-activation clear of the
+    // ReLU kink by more than the step of the finite differences, while
+    // both sides of the ReLU are still taken.
+    Dtype* x = this->blob_bottom_->mutable_cpu_data();
+    for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+      x[i] = (x[i] + (x[i] < 0 ? Dtype(-0.5) : Dtype(0.5))) / Dtype(1.5);
+    }
+    FillerParameter weight_filler;
+    weight_filler.set_type("uniform");
+    weight_filler.set_min(-0.05);
+    weight_filler.set_max(0.05);
+    int axis = IsHorizontal(direction) ? 3 : 2;
+    Blob<Dtype> permuted_bottom;
+    vector<Blob<Dtype>*> bottom_vec = this->blob_bottom_vec_;
+    if (permuted) {
+      axis = 0;
+      Permute(direction, *this->blob_bottom_, &permuted_bottom);
+      bottom_vec[0] = &permuted_bottom;
+    }
+    shared_ptr<Layer<Dtype> > layer = NewLayer(direction,
+        IRNNParam(direction, axis, weight_filler, options));
+    GradientChecker<Dtype> checker(1e-2, 1e-3);
+    checker.CheckGradientExhaustive(layer.get(), bottom_vec,
+        this->blob_top_vec_);
+  }
+
+  // Makes the inputs of channel c negative and those of the others
+  // positive. With recurrent weights close to the identity, the hidden
+  // states then stay at zero on channel c and grow on the others, clear of
+  // the ReLU kink on both.
+  void SignChannels(const int c) {
+    const int dim = this->blob_bottom_->count(2);
+    for (int n = 0; n < this->blob_bottom_->num(); ++n) {
+      for (int k = 0; k < this->blob_bottom_->channels(); ++k) {
+        Dtype* x = this->blob_bottom_->mutable_cpu_data() +
+            this->blob_bottom_->offset(n, k);
+        for (int i = 0; i < dim; ++i) {
+          x[i] = k == c ? -std::fabs(x[i]) : std::fabs(x[i]);
+        }
+      }
+    }
+  }
+
+  // Copies the N*C*H*W data, or diff, of nchw into the layout of the layer
+  // of direction on axis 0 if permuted is set.
+  static void Layout(const IRNNDirection direction, const bool permuted,
+      const Blob<Dtype>& nchw, const bool diff, Blob<Dtype>* blob) {
+    Blob<Dtype> data(nchw.shape());
+    caffe_copy(nchw.count(), diff ? nchw.cpu_diff() : nchw.cpu_data(),
+        data.mutable_cpu_data());
+    Blob<Dtype> permuted_data;
+    if (permuted) {
+      Permute(direction, data, &permuted_data);
+    }
+    const Blob<Dtype>& source = permuted ? permuted_data : data;
+    blob->ReshapeLike(source);
+    caffe_copy(source.count(), source.cpu_data(),
+        diff ? blob->mutable_cpu_diff() : blob->mutable_cpu_data());
+  }
+
+  // Element (n, c, h, w) of blob, which is laid out by Layout from a blob
+  // shaped as nchw.
+  static Dtype At(const IRNNDirection direction, const bool permuted,
+      const Blob<Dtype>& blob, const Blob<Dtype>& nchw, const int n,
+      const int c, const int h, const int w, const bool diff) {
+    const int offset = permuted ? PermutedOffset(direction, nchw.num(),
+        nchw.channels(), nchw.height(), nchw.width(), n, c, h, w) :
+        blob.offset(n, c, h, w);
+    return diff ? blob.cpu_diff()[offset] : blob.cpu_data()[offset];
+  }
+
+  // Runs the layer on a ragged batch of the bottom, whose samples are
+  // height x width as in sizes, and checks the top, the bottom diff and the
+  // weight diff against a run on each sample alone at its own size. The
+  // padding has to stay zero in the top and the bottom diff.
+  void TestRagged(const IRNNDirection direction, const bool permuted,
+      const Blob<Dtype>& sizes) {
+    FillerParameter weight_filler;
+    weight_filler.set_type("gaussian");
+    weight_filler.set_std(0.3);
+    const int N = this->blob_bottom_->num();
+    const int C = this->blob_bottom_->channels();
+    const int axis = permuted ? 0 : IsHorizontal(direction) ? 3 : 2;
+    shared_ptr<Layer<Dtype> > layer =
+        NewLayer(direction, IRNNParam(direction, axis, weight_filler));
+    Blob<Dtype> bottom;
+    Layout(direction, permuted, *this->blob_bottom_, false, &bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    bottom_vec.push_back(const_cast<Blob<Dtype>*>(&sizes));
+    layer->SetUp(bottom_vec, this->blob_top_vec_);
+    layer->Forward(bottom_vec, this->blob_top_vec_);
+    Blob<Dtype> top_diff(this->blob_bottom_->shape());
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        top_diff.mutable_cpu_diff());
+    Layout(direction, permuted, top_diff, true, this->blob_top_);
+    vector<bool> propagate_down(2, true);
+    propagate_down[1] = false;
+    layer->Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+
+    Blob<Dtype> w_diff;
+    w_diff.ReshapeLike(*layer->blobs()[0]);
+    for (int n = 0; n < N; ++n) {
+      const int height = static_cast<int>(sizes.cpu_data()[2 * n]);
+      const int width = static_cast<int>(sizes.cpu_data()[2 * n + 1]);
+      Blob<Dtype> sample(1, C, height, width);
+      Blob<Dtype> sample_top;
+      vector<Blob<Dtype>*> sample_bottom_vec(1, &sample);
+      vector<Blob<Dtype>*> sample_top_vec(1, &sample_top);
+      for (int c = 0; c < C; ++c) {
+        for (int h = 0; h < height; ++h) {
+          for (int w = 0; w < width; ++w) {
+            sample.mutable_cpu_data()[sample.offset(0, c, h, w)] =
+                this->blob_bottom_->data_at(n, c, h, w);
+          }
+        }
+      }
+      shared_ptr<Layer<Dtype> > sample_layer = NewLayer(direction,
+          IRNNParam(direction, IsHorizontal(direction) ? 3 : 2,
+          weight_filler));
+      sample_layer->blobs().push_back(shared_ptr<Blob<Dtype> >(
+          new Blob<Dtype>()));
+      sample_layer->blobs()[0]->CopyFrom(*layer->blobs()[0], false, true);
+      sample_layer->SetUp(sample_bottom_vec, sample_top_vec);
+      sample_layer->Forward(sample_bottom_vec, sample_top_vec);
+      for (int c = 0; c < C; ++c) {
+        for (int h = 0; h < height; ++h) {
+          for (int w = 0; w < width; ++w) {
+            sample_top.mutable_cpu_diff()[sample_top.offset(0, c, h, w)] =
+                top_diff.data_at(n, c, h, w);
+          }
+        }
+      }
+      sample_layer->Backward(sample_top_vec, vector<bool>(1, true),
+          sample_bottom_vec);
+      caffe_axpy(w_diff.count(), Dtype(1),
+          sample_layer->blobs()[0]->cpu_diff(), w_diff.mutable_cpu_data());
+
+      for (int c = 0; c < C; ++c) {
+        for (int h = 0; h < this->blob_bottom_->height(); ++h) {
+          for (int w = 0; w < this->blob_bottom_->width(); ++w) {
+            const bool padding = h >= height || w >= width;
+            const Dtype top = At(direction, permuted, *this->blob_top_,
+                *this->blob_bottom_, n, c, h, w, false);
+            const Dtype bottom_diff = At(direction, permuted, bottom,
+                *this->blob_bottom_, n, c, h, w, true);
+            if (padding) {
+              EXPECT_EQ(0, top);
+              EXPECT_EQ(0, bottom_diff);
+            } else {
+              EXPECT_NEAR(sample_top.data_at(0, c, h, w), top, 1e-4);
+              EXPECT_NEAR(sample.diff_at(0, c, h, w), bottom_diff, 1e-4);
+            }
+          }
+        }
+      }
+    }
+    for (int i = 0; i < w_diff.count(); ++i) {
+      EXPECT_NEAR(w_diff.cpu_data()[i], layer->blobs()[0]->cpu_diff()[i],
+          1e-4);
+    }
+  }
+
+  // Gradient check of the weights and the first bottom of a ragged batch.
+  void TestRaggedGradient(const IRNNDirection direction, const bool permuted,
+      const Blob<Dtype>& sizes) {
+    Dtype* x = this->blob_bottom_->mutable_cpu_data();
+    for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+      x[i] = (x[i] + (x[i] < 0 ? Dtype(-0.5) : Dtype(0.5))) / Dtype(1.5);
+    }
+    FillerParameter weight_filler;
+    weight_filler.set_type("uniform");
+    weight_filler.set_min(-0.05);
+    weight_filler.set_max(0.05);
+    const int axis = permuted ? 0 : IsHorizontal(direction) ? 3 : 2;
+    Blob<Dtype> bottom;
+    Layout(direction, permuted, *this->blob_bottom_, false, &bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    bottom_vec.push_back(const_cast<Blob<Dtype>*>(&sizes));
+    shared_ptr<Layer<Dtype> > layer =
+        NewLayer(direction, IRNNParam(direction, axis, weight_filler));
+    GradientChecker<Dtype> checker(1e-2, 1e-3);
+    checker.CheckGradientExhaustive(layer.get(), bottom_vec,
+        this->blob_top_vec_, 0);
+  }
+
+  // Runs the layer in place, with the top the bottom blob, and checks the
+  // top, the bottom diff and the weight diff against a run on a separate
+  // top. The finite differences of GradientChecker need the bottom to
+  // outlive the forward pass, so the gradient in place is checked against
+  // that of the separate run, which TestGradient covers.
+  void TestInPlace(const IRNNDirection direction, const bool permuted) {
+    FillerParameter weight_filler;
+    weight_filler.set_type("gaussian");
+    weight_filler.set_std(0.3);
+    const int axis = permuted ? 0 : IsHorizontal(direction) ? 3 : 2;
+    const LayerParameter param = IRNNParam(direction, axis, weight_filler);
+    Blob<Dtype> bottom;
+    Layout(direction, permuted, *this->blob_bottom_, false, &bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    shared_ptr<Layer<Dtype> > layer = NewLayer(direction, param);
+    layer->SetUp(bottom_vec, this->blob_top_vec_);
+    layer->Forward(bottom_vec, this->blob_top_vec_);
+    Blob<Dtype> top_diff(this->blob_bottom_->shape());
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        top_diff.mutable_cpu_diff());
+    Layout(direction, permuted, top_diff, true, this->blob_top_);
+    vector<bool> propagate_down(1, true);
+    layer->Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+
+    Blob<Dtype> in_place;
+    Layout(direction, permuted, *this->blob_bottom_, false, &in_place);
+    vector<Blob<Dtype>*> in_place_vec(1, &in_place);
+    shared_ptr<Layer<Dtype> > in_place_layer = NewLayer(direction, param);
+    in_place_layer->SetUp(in_place_vec, in_place_vec);
+    in_place_layer->blobs()[0]->CopyFrom(*layer->blobs()[0]);
+    in_place_layer->Forward(in_place_vec, in_place_vec);
+    for (int i = 0; i < in_place.count(); ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[i], in_place.cpu_data()[i],
+          1e-4);
+    }
+    Layout(direction, permuted, top_diff, true, &in_place);
+    in_place_layer->Backward(in_place_vec, propagate_down, in_place_vec);
+    for (int i = 0; i < in_place.count(); ++i) {
+      EXPECT_NEAR(bottom.cpu_diff()[i], in_place.cpu_diff()[i], 1e-4);
+    }
+    const Blob<Dtype>& w = *layer->blobs()[0];
+    for (int i = 0; i < w.count(); ++i) {
+      EXPECT_NEAR(w.cpu_diff()[i], in_place_layer->blobs()[0]->cpu_diff()[i],
+          1e-4);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(DirectionalIRNNLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestForwardUp) {
+  this->TestForward(IRNN_UP);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestForwardDown) {
+  this->TestForward(IRNN_DOWN);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestForwardLeft) {
+  this->TestForward(IRNN_LEFT);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestForwardRight) {
+  this->TestForward(IRNN_RIGHT);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientUp) {
+  this->TestGradient(IRNN_UP, false);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientUpPermuted) {
+  this->TestGradient(IRNN_UP, true);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientDown) {
+  this->TestGradient(IRNN_DOWN, false);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientDownPermuted) {
+  this->TestGradient(IRNN_DOWN, true);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientLeft) {
+  this->TestGradient(IRNN_LEFT, false);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientLeftPermuted) {
+  this->TestGradient(IRNN_LEFT, true);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientRight) {
+  this->TestGradient(IRNN_RIGHT, false);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientRightPermuted) {
+  this->TestGradient(IRNN_RIGHT, true);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestInPlace) {
+  const IRNNDirection directions[] = {IRNN_UP, IRNN_DOWN, IRNN_LEFT,
+      IRNN_RIGHT};
+  for (int d = 0; d < 4; ++d) {
+    this->TestInPlace(directions[d], false);
+    this->TestInPlace(directions[d], true);
+  }
+}
+
+// U and V of the low-rank weights W = I + U * V, blobs 0 and 1.
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientLowRank) {
+  this->SignChannels(1);
+  this->TestGradient(IRNN_LEFT, false, "rank: 2");
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientLowRankPermuted) {
+  this->SignChannels(1);
+  this->TestGradient(IRNN_UP, true, "rank: 2");
+}
+
+// The identity filler starts the low-rank weights at W = I exactly, with
+// U = 0, so the layer only sums up its input along the direction.
+TYPED_TEST(DirectionalIRNNLayerTest, TestLowRankIdentity) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter weight_filler;
+  weight_filler.set_type("identity");
+  shared_ptr<Layer<Dtype> > layer = this->NewLayer(IRNN_DOWN,
+      this->IRNNParam(IRNN_DOWN, 2, weight_filler, "rank: 2"));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(layer->blobs().size(), 2);
+  const Blob<Dtype>& u = *layer->blobs()[0];
+  for (int i = 0; i < u.count(); ++i) {
+    EXPECT_EQ(0, u.cpu_data()[i]);
+  }
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int C = this->blob_bottom_->channels();
+  vector<Dtype> identity(C * C, Dtype(0));
+  for (int c = 0; c < C; ++c) {
+    identity[c * C + c] = Dtype(1);
+  }
+  Blob<Dtype> expected;
+  this->Reference(IRNN_DOWN, *this->blob_bottom_, &identity[0], &expected);
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+}
+
+// The per-channel weights of the diagonal recurrence, on the GPU as well.
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientDiagonal) {
+  this->TestGradient(IRNN_RIGHT, false, "recurrence: DIAGONAL");
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientDiagonalPermuted) {
+  this->TestGradient(IRNN_DOWN, true, "recurrence: DIAGONAL");
+}
+
+// Grouped weights, NH x NH/G, give the top of dense weights with the same
+// blocks on the diagonal and zero elsewhere, on both layouts.
+TYPED_TEST(DirectionalIRNNLayerTest, TestForwardGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBottom(2, 6, 4, 5);
+  const int NH = 6;
+  const int G = 3;
+  const int NB = NH / G;
+  FillerParameter weight_filler;
+  weight_filler.set_type("gaussian");
+  weight_filler.set_std(0.3);
+  const IRNNDirection directions[] = {IRNN_LEFT, IRNN_UP};
+  for (int d = 0; d < 2; ++d) {
+    for (int permuted = 0; permuted < 2; ++permuted) {
+      const IRNNDirection direction = directions[d];
+      const int axis = permuted ? 0 : this->IsHorizontal(direction) ? 3 : 2;
+      Blob<Dtype> bottom;
+      this->Layout(direction, permuted, *this->blob_bottom_, false, &bottom);
+      vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+      shared_ptr<Layer<Dtype> > layer = this->NewLayer(direction,
+          this->IRNNParam(direction, axis, weight_filler, "group: 3"));
+      layer->SetUp(bottom_vec, this->blob_top_vec_);
+      ASSERT_EQ(layer->blobs()[0]->shape(0), NH);
+      ASSERT_EQ(layer->blobs()[0]->shape(1), NB);
+      layer->Forward(bottom_vec, this->blob_top_vec_);
+
+      vector<int> w_shape(2, NH);
+      shared_ptr<Blob<Dtype> > dense_w(new Blob<Dtype>(w_shape));
+      const Dtype* blocks = layer->blobs()[0]->cpu_data();
+      Dtype* w = dense_w->mutable_cpu_data();
+      for (int c = 0; c < NH; ++c) {
+        for (int k = 0; k < NH; ++k) {
+          w[c * NH + k] = k / NB == c / NB ? blocks[c * NB + k % NB] : 0;
+        }
+      }
+      Blob<Dtype> dense_top;
+      vector<Blob<Dtype>*> dense_top_vec(1, &dense_top);
+      shared_ptr<Layer<Dtype> > dense_layer = this->NewLayer(direction,
+          this->IRNNParam(direction, axis, weight_filler));
+      dense_layer->blobs().push_back(dense_w);
+      dense_layer->SetUp(bottom_vec, dense_top_vec);
+      dense_layer->Forward(bottom_vec, dense_top_vec);
+      this->ExpectBlobsNear(dense_top, *this->blob_top_, false, 1e-4);
+    }
+  }
+}
+
+// The NH x NH/G weight blob of grouped weights.
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientGroup) {
+  this->ReshapeBottom(2, 4, 4, 5);
+  this->TestGradient(IRNN_DOWN, false, "group: 2");
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientGroupPermuted) {
+  this->ReshapeBottom(2, 4, 4, 5);
+  this->TestGradient(IRNN_LEFT, true, "group: 2");
+}
+
+// Samples of 4x2 and 2x5 in the 4x5 map of the bottom, the first one
+// spanning the height and the second the width.
+template <typename Dtype>
+static void RaggedSizes(Blob<Dtype>* sizes) {
+  sizes->Reshape(vector<int>(2, 2));
+  Dtype* size = sizes->mutable_cpu_data();
+  size[0] = 4;
+  size[1] = 2;
+  size[2] = 2;
+  size[3] = 5;
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestRagged) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> sizes;
+  RaggedSizes(&sizes);
+  const IRNNDirection directions[] = {IRNN_UP, IRNN_DOWN, IRNN_LEFT,
+      IRNN_RIGHT};
+  for (int d = 0; d < 4; ++d) {
+    this->TestRagged(directions[d], false, sizes);
+    this->TestRagged(directions[d], true, sizes);
+  }
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientRaggedUp) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> sizes;
+  RaggedSizes(&sizes);
+  this->TestRaggedGradient(IRNN_UP, false, sizes);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientRaggedUpPermuted) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> sizes;
+  RaggedSizes(&sizes);
+  this->TestRaggedGradient(IRNN_UP, true, sizes);
+}
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientRaggedLeft) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> sizes;
+  RaggedSizes(&sizes);
+  this->TestRaggedGradient(IRNN_LEFT, false, sizes);
+}
+
+
+TYPED_TEST(DirectionalIRNNLayerTest, TestGradientRaggedLeftPermuted) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> sizes;
+  RaggedSizes(&sizes);
+  this->TestRaggedGradient(IRNN_LEFT, true, sizes);
+}
+
+// The memory behind blob, which a Reshape that outgrows it replaces.
+template <typename T>
+static const void* BlobMemory(const Blob<T>& blob) {
+  return blob.count() > 0 ? blob.data().get() : NULL;
+}
+
+// A directional layer that shows the buffers it keeps from one pass to the
+// next.
+template <typename Dtype, template <typename> class IRNNLayer>
+class IRNNBuffersLayer : public IRNNLayer<Dtype> {
+ public:
+  explicit IRNNBuffersLayer(const LayerParameter& param)
+      : IRNNLayer<Dtype>(param) {}
+  vector<const void*> Buffers() const {
+    vector<const void*> buffers;
+    buffers.push_back(BlobMemory(this->hh_));
+    buffers.push_back(BlobMemory(this->trans_));
+    buffers.push_back(BlobMemory(this->extent_));
+    buffers.push_back(BlobMemory(this->dense_w_));
+    return buffers;
+  }
+};
+
+// The options that only the CPU passes implement.
+template <typename Dtype>
+class DirectionalIRNNCPUTest
+    : public DirectionalIRNNLayerTest<CPUDevice<Dtype> > {
+ protected:
+  typedef DirectionalIRNNLayerTest<CPUDevice<Dtype> > Base;
+
+  // Two forward passes of layer on bottom, as a tracker sees the same crop
+  // twice, then a backward pass with top_diff. result is set to the top,
+  // then to blobs whose diffs are those of the bottom and the weights.
+  static void Pass(Layer<Dtype>* layer, Blob<Dtype>* bottom,
+      const Blob<Dtype>& top_diff, Blob<Dtype>* top,
+      vector<shared_ptr<Blob<Dtype> > >* result) {
+    vector<Blob<Dtype>*> bottom_vec(1, bottom);
+    vector<Blob<Dtype>*> top_vec(1, top);
+    layer->Reshape(bottom_vec, top_vec);
+    layer->Forward(bottom_vec, top_vec);
+    layer->Forward(bottom_vec, top_vec);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(), top->mutable_cpu_diff());
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      Blob<Dtype>* blob = layer->blobs()[i].get();
+      caffe_set(blob->count(), Dtype(0), blob->mutable_cpu_diff());
+    }
+    layer->Backward(top_vec, vector<bool>(1, true), bottom_vec);
+    result->clear();
+    result->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    result->back()->CopyFrom(*top, false, true);
+    result->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    result->back()->CopyFrom(*bottom, true, true);
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      result->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      result->back()->CopyFrom(*layer->blobs()[i], true, true);
+    }
+  }
+
+  // Cycles layer three times through bottoms, on a thread of its own whose
+  // workspace starts empty, and checks every pass against expected. Neither
+  // the workspace nor the buffers of the layer and its top may grow after
+  // the first cycle.
+  template <template <typename> class IRNNLayer>
+  static void RunCycles(IRNNBuffersLayer<Dtype, IRNNLayer>* layer,
+      vector<shared_ptr<Blob<Dtype> > >* bottoms,
+      const vector<shared_ptr<Blob<Dtype> > >* top_diffs,
+      const vector<vector<shared_ptr<Blob<Dtype> > > >* expected) {
+    Blob<Dtype> top;
+    size_t capacity = 0;
+    vector<const void*> buffers;
+    const void* top_memory = NULL;
+    for (int cycle = 0; cycle < 3; ++cycle) {
+      for (int i = 0; i < bottoms->size(); ++i) {
+        vector<shared_ptr<Blob<Dtype> > > result;
+        Pass(layer, (*bottoms)[i].get(), *(*top_diffs)[i], &top, &result);
+        ASSERT_EQ((*expected)[i].size(), result.size());
+        for (int j = 0; j < result.size(); ++j) {
+          SCOPED_TRACE(testing::Message() << "cycle " << cycle << ", size "
+              << i << ", blob " << j);
+          Base::ExpectBlobsNear(*(*expected)[i][j], *result[j], j > 0, 1e-5);
+        }
+      }
+      if (cycle == 0) {
+        capacity = IRNNWorkspace::Get().capacity();
+        buffers = layer->Buffers();
+        top_memory = BlobMemory(top);
+      } else {
+        EXPECT_EQ(capacity, IRNNWorkspace::Get().capacity());
+        EXPECT_TRUE(buffers == layer->Buffers()) << "cycle " << cycle;
+        EXPECT_EQ(top_memory, BlobMemory(top));
+      }
+    }
+  }
+
+  // A layer of direction with options reshaped through three sizes, the
+  // largest in the middle, against fresh layers set up at each size.
+  template <template <typename> class IRNNLayer>
+  void TestReshapeCycles(const IRNNDirection direction,
+      const string& options) {
+    const int shapes[3][4] = {{2, 3, 4, 5}, {3, 3, 6, 7}, {1, 3, 7, 3}};
+    FillerParameter weight_filler;
+    weight_filler.set_type("gaussian");
+    weight_filler.set_std(0.3);
+    const LayerParameter param = this->IRNNParam(direction,
+        this->IsHorizontal(direction) ? 3 : 2, weight_filler, options);
+    vector<shared_ptr<Blob<Dtype> > > bottoms;
+    vector<shared_ptr<Blob<Dtype> > > top_diffs;
+    for (int i = 0; i < 3; ++i) {
+      bottoms.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+          shapes[i][0], shapes[i][1], shapes[i][2], shapes[i][3])));
+      top_diffs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+          bottoms[i]->shape())));
+      caffe_rng_uniform<Dtype>(bottoms[i]->count(), Dtype(-1), Dtype(1),
+          bottoms[i]->mutable_cpu_data());
+      caffe_rng_uniform<Dtype>(top_diffs[i]->count(), Dtype(-1), Dtype(1),
+          top_diffs[i]->mutable_cpu_data());
+    }
+    IRNNBuffersLayer<Dtype, IRNNLayer> layer(param);
+    Blob<Dtype> top;
+    layer.SetUp(vector<Blob<Dtype>*>(1, bottoms[0].get()),
+        vector<Blob<Dtype>*>(1, &top));
+    vector<vector<shared_ptr<Blob<Dtype> > > > expected(3);
+    for (int i = 0; i < 3; ++i) {
+      shared_ptr<Layer<Dtype> > fresh = this->NewLayer(direction, param);
+      Blob<Dtype> fresh_top;
+      fresh->SetUp(vector<Blob<Dtype>*>(1, bottoms[i].get()),
+          vector<Blob<Dtype>*>(1, &fresh_top));
+      for (int j = 0; j < fresh->blobs().size(); ++j) {
+        fresh->blobs()[j]->CopyFrom(*layer.blobs()[j]);
+      }
+      Pass(fresh.get(), bottoms[i].get(), *top_diffs[i], &fresh_top,
+          &expected[i]);
+    }
+    boost::thread thread(
+        &DirectionalIRNNCPUTest<Dtype>::template RunCycles<IRNNLayer>,
+        &layer, &bottoms, &top_diffs, &expected);
+    thread.join();
+  }
+
+  // Forward and backward passes of layer on a ragged batch, with top_diff
+  // as the top diff. bytes is set to the workspace they borrowed: run on a
+  // thread of its own, whose workspace starts empty, that is what they
+  // asked for.
+  static void RunRagged(Layer<Dtype>* layer, Blob<Dtype>* bottom,
+      Blob<Dtype>* sizes, const Blob<Dtype>* top_diff, Blob<Dtype>* top,
+      size_t* bytes) {
+    vector<Blob<Dtype>*> bottom_vec(1, bottom);
+    bottom_vec.push_back(sizes);
+    vector<Blob<Dtype>*> top_vec(1, top);
+    layer->Forward(bottom_vec, top_vec);
+    caffe_copy(top_diff->count(), top_diff->cpu_data(),
+        top->mutable_cpu_diff());
+    vector<bool> propagate_down(2, true);
+    propagate_down[1] = false;
+    layer->Backward(top_vec, propagate_down, bottom_vec);
+    *bytes = IRNNWorkspace::Get().capacity();
+  }
+
+  // A ragged batch of a single sample one line short of the map, whose
+  // shorter scan lines let the bf16 weight diff convert two steps at a
+  // time where the full sweep converts one. The bf16 pass has to borrow
+  // the buffer of the sample's sweep, and match the diffs of the float one.
+  void TestRaggedBf16() {
+    this->ReshapeBottom(1, 2, 513, 16);
+    vector<int> sizes_shape(2, 1);
+    sizes_shape[1] = 2;
+    Blob<Dtype> sizes(sizes_shape);
+    sizes.mutable_cpu_data()[0] = 512;
+    sizes.mutable_cpu_data()[1] = 16;
+    FillerParameter weight_filler;
+    weight_filler.set_type("uniform");
+    weight_filler.set_min(-0.05);
+    weight_filler.set_max(0.05);
+    Blob<Dtype> top_diff(this->blob_bottom_->shape());
+    caffe_rng_uniform<Dtype>(top_diff.count(), Dtype(-1), Dtype(1),
+        top_diff.mutable_cpu_data());
+    Blob<Dtype> bottoms[2];
+    Blob<Dtype> tops[2];
+    shared_ptr<Layer<Dtype> > layers[2];
+    size_t bytes[2];
+    for (int bf16 = 0; bf16 < 2; ++bf16) {
+      layers[bf16] = this->NewLayer(IRNN_LEFT, this->IRNNParam(IRNN_LEFT, 3,
+          weight_filler, bf16 ? "bf16_storage: true" : ""));
+      bottoms[bf16].CopyFrom(*this->blob_bottom_, false, true);
+      vector<Blob<Dtype>*> bottom_vec(1, &bottoms[bf16]);
+      bottom_vec.push_back(&sizes);
+      vector<Blob<Dtype>*> top_vec(1, &tops[bf16]);
+      layers[bf16]->SetUp(bottom_vec, top_vec);
+      layers[bf16]->blobs()[0]->CopyFrom(*layers[0]->blobs()[0]);
+      boost::thread thread(&DirectionalIRNNCPUTest<Dtype>::RunRagged,
+          layers[bf16].get(), &bottoms[bf16], &sizes, &top_diff,
+          &tops[bf16], &bytes[bf16]);
+      thread.join();
+    }
+    // the bf16 states and diffs, the buffer of the sample and one step
+    int offset;
+    const IRNNSweep sample = irnn_group_sweep(irnn_nchw_sweep(1, 2, 16, 513,
+        2 * 513 * 16, true), 0, 16, 512, &offset);
+    EXPECT_GE(bytes[1], (2 * 513 * 16 + irnn_weight_diff_buffer(sample) +
+        2 * 513) * sizeof(Dtype));
+    this->ExpectBlobsNear(bottoms[0], bottoms[1], true, 1e-2);
+    // the weight diff sums over the whole map, so relative to its largest
+    const Blob<Dtype>& w = *layers[0]->blobs()[0];
+    Dtype scale = 0;
+    for (int i = 0; i < w.count(); ++i) {
+      scale = std::max(scale, std::fabs(w.cpu_diff()[i]));
+    }
+    this->ExpectBlobsNear(w, *layers[1]->blobs()[0], true,
+        Dtype(1e-2) * scale);
+  }
+
+  // Changes one row or column of the bottom after the other and checks the
+  // top of the incremental layer against a full pass with the same weights,
+  // with the changed positions declared if hint is set. A change of the
+  // weights while the hint only declares the last position must still give
+  // a full pass.
+  void TestIncremental(const IRNNDirection direction, const bool permuted,
+      const bool hint) {
+    FillerParameter weight_filler;
+    weight_filler.set_type("gaussian");
+    weight_filler.set_std(0.3);
+    const int axis = permuted ? 0 : this->IsHorizontal(direction) ? 3 : 2;
+    shared_ptr<Layer<Dtype> > layer = this->NewLayer(direction,
+        this->IRNNParam(direction, axis, weight_filler, "incremental: true"));
+    shared_ptr<Layer<Dtype> > full_layer = this->NewLayer(direction,
+        this->IRNNParam(direction, axis, weight_filler));
+    BaseIRNNLayer<Dtype>* incremental =
+        dynamic_cast<BaseIRNNLayer<Dtype>*>(layer.get());
+    ASSERT_TRUE(incremental != NULL);
+    Blob<Dtype> bottom;
+    Blob<Dtype> full_top;
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    vector<Blob<Dtype>*> full_top_vec(1, &full_top);
+    if (permuted) {
+      this->Permute(direction, *this->blob_bottom_, &bottom);
+    } else {
+      bottom.CopyFrom(*this->blob_bottom_, false, true);
+    }
+    layer->SetUp(bottom_vec, this->blob_top_vec_);
+    full_layer->blobs().push_back(layer->blobs()[0]);
+    full_layer->SetUp(bottom_vec, full_top_vec);
+    layer->Forward(bottom_vec, this->blob_top_vec_);
+
+    const int positions = this->IsHorizontal(direction) ?
+        this->blob_bottom_->width() : this->blob_bottom_->height();
+    // the same bottom, then a change at each position, then the weights
+    for (int position = -1; position <= positions; ++position) {
+      if (position >= 0 && position < positions) {
+        this->FillPosition(direction, position, this->blob_bottom_);
+      }
+      if (permuted) {
+        this->Permute(direction, *this->blob_bottom_, &bottom);
+      } else {
+        bottom.CopyFrom(*this->blob_bottom_);
+      }
+      if (position == positions) {
+        caffe_scal(layer->blobs()[0]->count(), Dtype(0.9),
+            layer->blobs()[0]->mutable_cpu_data());
+      }
+      if (hint && position < 0) {
+        incremental->set_changed_positions(0, 0);
+      } else if (hint && position < positions) {
+        incremental->set_changed_positions(position, position + 1);
+      } else if (hint) {
+        incremental->set_changed_positions(positions - 1, positions);
+      }
+      layer->Forward(bottom_vec, this->blob_top_vec_);
+      full_layer->Forward(bottom_vec, full_top_vec);
+      this->ExpectBlobsNear(full_top, *this->blob_top_, false, 1e-5);
+    }
+  }
+
+  // The int8 calibration passes have to see every input, so memoize must
+  // not return the cached top of a calibration pass: through calibration
+  // and after it, a memoized layer gives the tops of one without memoize
+  // on the same bottom, and the quantized tops differ from the float one.
+  void TestInt8Memoize(const IRNNDirection direction) {
+    FillerParameter weight_filler;
+    weight_filler.set_type("gaussian");
+    weight_filler.set_std(0.3);
+    const int axis = this->IsHorizontal(direction) ? 3 : 2;
+    const string int8 = "int8: true int8_calibration_iter: 2";
+    LayerParameter param = this->IRNNParam(direction, axis, weight_filler,
+        int8 + " memoize: true");
+    param.set_phase(TEST);
+    LayerParameter int8_param = this->IRNNParam(direction, axis,
+        weight_filler, int8);
+    int8_param.set_phase(TEST);
+    LayerParameter float_param = this->IRNNParam(direction, axis,
+        weight_filler);
+    float_param.set_phase(TEST);
+    shared_ptr<Layer<Dtype> > layer = this->NewLayer(direction, param);
+    shared_ptr<Layer<Dtype> > int8_layer =
+        this->NewLayer(direction, int8_param);
+    shared_ptr<Layer<Dtype> > float_layer =
+        this->NewLayer(direction, float_param);
+    Blob<Dtype> int8_top;
+    Blob<Dtype> float_top;
+    vector<Blob<Dtype>*> int8_top_vec(1, &int8_top);
+    vector<Blob<Dtype>*> float_top_vec(1, &float_top);
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    int8_layer->blobs().push_back(layer->blobs()[0]);
+    int8_layer->SetUp(this->blob_bottom_vec_, int8_top_vec);
+    float_layer->blobs().push_back(layer->blobs()[0]);
+    float_layer->SetUp(this->blob_bottom_vec_, float_top_vec);
+    float_layer->Forward(this->blob_bottom_vec_, float_top_vec);
+    for (int pass = 0; pass < 4; ++pass) {
+      layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      int8_layer->Forward(this->blob_bottom_vec_, int8_top_vec);
+      for (int i = 0; i < int8_top.count(); ++i) {
+        ASSERT_EQ(int8_top.cpu_data()[i], this->blob_top_->cpu_data()[i])
+            << "pass " << pass;
+      }
+    }
+    Dtype difference = 0;
+    for (int i = 0; i < float_top.count(); ++i) {
+      difference = std::max(difference,
+          std::fabs(float_top.cpu_data()[i] - int8_top.cpu_data()[i]));
+    }
+    EXPECT_GT(difference, 0);
+  }
+
+  // After calibration, the top of the int8 layer is within 1e-2 of the
+  // float one, relative to the largest hidden state. The hidden states are
+  // quantized to 1/255 of the largest one of their channel and the weights
+  // to 1/127 of the largest of their row, and the error of a step carries
+  // on to the next ones; 16 channels over 6 or 7 steps stay around 3e-3.
+  void TestInt8Accuracy(const IRNNDirection direction, const bool permuted) {
+    this->ReshapeBottom(2, 16, 6, 7);
+    FillerParameter weight_filler;
+    weight_filler.set_type("gaussian");
+    weight_filler.set_std(0.1);
+    const int axis = permuted ? 0 : this->IsHorizontal(direction) ? 3 : 2;
+    LayerParameter param = this->IRNNParam(direction, axis, weight_filler,
+        "int8: true int8_calibration_iter: 1");
+    param.set_phase(TEST);
+    LayerParameter float_param = this->IRNNParam(direction, axis,
+        weight_filler);
+    float_param.set_phase(TEST);
+    Blob<Dtype> bottom;
+    this->Layout(direction, permuted, *this->blob_bottom_, false, &bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    shared_ptr<Layer<Dtype> > layer = this->NewLayer(direction, param);
+    shared_ptr<Layer<Dtype> > float_layer =
+        this->NewLayer(direction, float_param);
+    Blob<Dtype> float_top;
+    vector<Blob<Dtype>*> float_top_vec(1, &float_top);
+    layer->SetUp(bottom_vec, this->blob_top_vec_);
+    float_layer->blobs().push_back(layer->blobs()[0]);
+    float_layer->SetUp(bottom_vec, float_top_vec);
+    float_layer->Forward(bottom_vec, float_top_vec);
+    // the calibration pass, then the int8 one
+    layer->Forward(bottom_vec, this->blob_top_vec_);
+    layer->Forward(bottom_vec, this->blob_top_vec_);
+    Dtype error = 0;
+    Dtype scale = 0;
+    for (int i = 0; i < float_top.count(); ++i) {
+      error = std::max(error, std::fabs(this->blob_top_->cpu_data()[i] -
+          float_top.cpu_data()[i]));
+      scale = std::max(scale, std::fabs(float_top.cpu_data()[i]));
+    }
+    EXPECT_GT(error, 0);
+    EXPECT_LE(error, 1e-2 * scale);
+  }
+};
+
+TYPED_TEST_CASE(DirectionalIRNNCPUTest, TestDtypes);
+
+TYPED_TEST(DirectionalIRNNCPUTest, TestReshapeCycles) {
+  const char* options[] = {"", "rank: 2", "memoize: true",
+      "incremental: true", "bf16_storage: true"};
+  for (int i = 0; i < 5; ++i) {
+    SCOPED_TRACE(options[i]);
+    this->template TestReshapeCycles<RNNLEFTLayer>(IRNN_LEFT, options[i]);
+    this->template TestReshapeCycles<RNNUPLayer>(IRNN_UP, options[i]);
+  }
+}
+
+TYPED_TEST(DirectionalIRNNCPUTest, TestRaggedBf16) {
+  this->TestRaggedBf16();
+}
+
+TYPED_TEST(DirectionalIRNNCPUTest, TestIncremental) {
+  const IRNNDirection directions[] = {IRNN_UP, IRNN_DOWN, IRNN_LEFT,
+      IRNN_RIGHT};
+  for (int d = 0; d < 4; ++d) {
+    for (int permuted = 0; permuted < 2; ++permuted) {
+      this->TestIncremental(directions[d], permuted, false);
+      this->TestIncremental(directions[d], permuted, true);
+    }
+  }
+}
+
+TYPED_TEST(DirectionalIRNNCPUTest, TestInt8Memoize) {
+  this->TestInt8Memoize(IRNN_DOWN);
+  this->TestInt8Memoize(IRNN_LEFT);
+}
+
+TYPED_TEST(DirectionalIRNNCPUTest, TestInt8Accuracy) {
+  this->TestInt8Accuracy(IRNN_DOWN, false);
+  this->TestInt8Accuracy(IRNN_LEFT, false);
+  this->TestInt8Accuracy(IRNN_UP, true);
+  this->TestInt8Accuracy(IRNN_RIGHT, true);
+}
+
+}  // namespace caffe
@@ -0,0 +1,145 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/irnn_cache.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class IRNNOutputCacheTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  IRNNOutputCacheTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 4, 5)),
+        blob_top_(new Blob<Dtype>(2, 3, 4, 5)) {
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    filler.Fill(this->blob_top_);
+    for (int i = 0; i < 2; ++i) {
+      weights_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(3, 3, 1,
+          1)));
+      filler.Fill(weights_.back().get());
+    }
+  }
+  virtual ~IRNNOutputCacheTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  // Restores into a zeroed top, which on a hit has to be the stored one.
+  bool Restore(IRNNOutputCache<Dtype>* cache) {
+    Blob<Dtype> top(blob_top_->shape());
+    const bool hit = cache->Restore(*blob_bottom_, weights_, &top);
+    for (int i = 0; hit && i < top.count(); ++i) {
+      EXPECT_EQ(blob_top_->cpu_data()[i], top.cpu_data()[i]);
+    }
+    return hit;
+  }
+
+  static void Change(Blob<Dtype>* blob, const int index) {
+    blob->mutable_cpu_data()[index] += Dtype(0.5);
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<shared_ptr<Blob<Dtype> > > weights_;
+};
+
+TYPED_TEST_CASE(IRNNOutputCacheTest, TestDtypesAndDevices);
+
+TYPED_TEST(IRNNOutputCacheTest, TestHit) {
+  typedef typename TypeParam::Dtype Dtype;
+  IRNNOutputCache<Dtype> cache;
+  cache.SetUp(true);
+  EXPECT_FALSE(this->Restore(&cache));
+  cache.Store(*this->blob_top_);
+  EXPECT_TRUE(this->Restore(&cache));
+  EXPECT_TRUE(this->Restore(&cache));
+  EXPECT_EQ(this->blob_top_->count() * sizeof(Dtype), cache.bytes());
+}
+
+TYPED_TEST(IRNNOutputCacheTest, TestMissBottom) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int count = this->blob_bottom_->count();
+  const int indices[] = {0, count / 2, count - 1};
+  for (int i = 0; i < 3; ++i) {
+    IRNNOutputCache<Dtype> cache;
+    cache.SetUp(true);
+    EXPECT_FALSE(this->Restore(&cache));
+    cache.Store(*this->blob_top_);
+    this->Change(this->blob_bottom_, indices[i]);
+    EXPECT_FALSE(this->Restore(&cache)) << "element " << indices[i];
+    // the new bottom is cached from then on
+    cache.Store(*this->blob_top_);
+    EXPECT_TRUE(this->Restore(&cache));
+  }
+}
+
+TYPED_TEST(IRNNOutputCacheTest, TestMissWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  IRNNOutputCache<Dtype> cache;
+  cache.SetUp(true);
+  EXPECT_FALSE(this->Restore(&cache));
+  cache.Store(*this->blob_top_);
+  this->Change(this->weights_[1].get(), 4);
+  EXPECT_FALSE(this->Restore(&cache));
+}
+
+// While frozen the bottom is not checked, but the weights still are, e.g.
+// after an update of the solver.
+TYPED_TEST(IRNNOutputCacheTest, TestFrozen) {
+  typedef typename TypeParam::Dtype Dtype;
+  for (int fingerprint = 0; fingerprint < 2; ++fingerprint) {
+    IRNNOutputCache<Dtype> cache;
+    cache.SetUp(fingerprint);
+    cache.set_frozen(true);
+    EXPECT_FALSE(this->Restore(&cache));
+    cache.Store(*this->blob_top_);
+    this->Change(this->blob_bottom_, 7);
+    EXPECT_TRUE(this->Restore(&cache));
+    this->Change(this->weights_[0].get(), 0);
+    EXPECT_FALSE(this->Restore(&cache));
+  }
+}
+
+// A different shape of the bottom misses even while frozen.
+TYPED_TEST(IRNNOutputCacheTest, TestMissShape) {
+  typedef typename TypeParam::Dtype Dtype;
+  IRNNOutputCache<Dtype> cache;
+  cache.SetUp(true);
+  cache.set_frozen(true);
+  EXPECT_FALSE(this->Restore(&cache));
+  cache.Store(*this->blob_top_);
+  this->blob_bottom_->Reshape(2, 3, 5, 4);
+  EXPECT_FALSE(this->Restore(&cache));
+}
+
+TYPED_TEST(IRNNOutputCacheTest, TestOff) {
+  typedef typename TypeParam::Dtype Dtype;
+  IRNNOutputCache<Dtype> cache;
+  cache.SetUp(false);
+  EXPECT_FALSE(this->Restore(&cache));
+  cache.Store(*this->blob_top_);
+  EXPECT_FALSE(this->Restore(&cache));
+  EXPECT_EQ(0, cache.bytes());
+}
+
+}  // namespace caffe
@@ -0,0 +1,97 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/irnn_int8.hpp"
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// The dot products are integer sums, so every instruction set has to give
+// the hidden states of the scalar loop bit for bit.
+class IRNNInt8DotTest : public ::testing::Test {
+ protected:
+  IRNNInt8DotTest() : isa_(irnn_int8_isa()) {}
+  virtual ~IRNNInt8DotTest() {
+    // back to the pick for the host
+    irnn_int8_set_isa(isa_);
+  }
+
+  // Runs an int8 sweep of 3 steps over x, channels x length per step, with
+  // the dot products of isa into h.
+  static void Sweep(const string& isa, const int channels, const int length,
+      const Blob<float>& x, const Blob<float>& w, Blob<float>* h) {
+    ASSERT_TRUE(irnn_int8_set_isa(isa));
+    const IRNNSweep sweep = irnn_nchw_sweep(1, channels, 3, length,
+        x.count(), false);
+    IRNNInt8<float> int8;
+    int8.SetUp(channels, 1);
+    int8.Reshape(sweep);
+    h->CopyFrom(x, false, true);
+    // scales from the magnitudes of the input, which are not all 0
+    Blob<float> h_max;
+    h_max.ReshapeLike(x);
+    caffe_abs(x.count(), x.cpu_data(), h_max.mutable_cpu_data());
+    int8.Calibrate(sweep, h_max.cpu_data());
+    int8.QuantizeWeights(w.cpu_data());
+    int8.Forward(sweep, h->mutable_cpu_data());
+  }
+
+  const string isa_;
+};
+
+TEST_F(IRNNInt8DotTest, TestISAs) {
+  Caffe::set_mode(Caffe::CPU);
+  const char* isas[] = {"avx512vnni", "avxvnni", "avx2"};
+  // a single call on the partial groups of lines, full ones and both
+  const int lengths[] = {1, 2, 3, 5, 7, 8, 9, 15, 16, 17};
+  for (int i = 0; i < 3; ++i) {
+    if (!irnn_int8_set_isa(isas[i])) {
+      LOG(INFO) << "Skipping " << isas[i] << ", not run by this host";
+      continue;
+    }
+    for (int words = 1; words <= 70; ++words) {
+      // full words and a last word of 1 to 3 channels
+      const int channels = 4 * words - words % 4;
+      Blob<float> w(1, 1, channels, channels);
+      caffe_rng_gaussian<float>(w.count(), 0.f,
+          1.f / std::sqrt(static_cast<float>(channels)),
+          w.mutable_cpu_data());
+      for (int j = 0; j < 10; ++j) {
+        Blob<float> x(1, channels, 3, lengths[j]);
+        caffe_rng_uniform<float>(x.count(), -1.f, 1.f, x.mutable_cpu_data());
+        Blob<float> expected;
+        Blob<float> h;
+        Sweep("scalar", channels, lengths[j], x, w, &expected);
+        Sweep(isas[i], channels, lengths[j], x, w, &h);
+        for (int k = 0; k < h.count(); ++k) {
+          ASSERT_EQ(expected.cpu_data()[k], h.cpu_data()[k]) << isas[i]
+              << ", " << words << " words, " << lengths[j] << " lines";
+        }
+      }
+    }
+  }
+}
+
+TEST_F(IRNNInt8DotTest, TestSetISA) {
+  EXPECT_TRUE(irnn_int8_set_isa("scalar"));
+  EXPECT_EQ(string("scalar"), irnn_int8_isa());
+  EXPECT_FALSE(irnn_int8_set_isa("sse9"));
+  EXPECT_EQ(string("scalar"), irnn_int8_isa());
+}
+
+}  // namespace caffe
@@ -0,0 +1,216 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+enum IRNNMathWeights { IRNN_DENSE, IRNN_LOW_RANK, IRNN_DIAGONAL };
+
+// The CPU sweeps cut the scan lines into slabs for the workers and into
+// tiles that stay in cache. Neither may change a scan line, so every cut
+// has to give the hidden states and the diffs of a single slab of a single
+// tile. This host may have a single worker and a large L2, so the slabs
+// are run one after the other and the tile is set on the sweep.
+template <typename Dtype>
+class IRNNMathTest : public CPUDeviceTest<Dtype> {
+ protected:
+  IRNNMathTest()
+      : channels_(6), rank_(2), x_(2, 6, 5, 70), top_diff_(2, 6, 5, 70) {
+    caffe_rng_uniform<Dtype>(x_.count(), Dtype(-1), Dtype(1),
+        x_.mutable_cpu_data());
+    caffe_rng_uniform<Dtype>(top_diff_.count(), Dtype(-1), Dtype(1),
+        top_diff_.mutable_cpu_data());
+    w_.Reshape(1, 1, channels_, channels_);
+    u_.Reshape(1, 1, channels_, rank_);
+    v_.Reshape(1, 1, rank_, channels_);
+    caffe_rng_gaussian<Dtype>(w_.count(), Dtype(0), Dtype(0.3),
+        w_.mutable_cpu_data());
+    caffe_rng_gaussian<Dtype>(u_.count(), Dtype(0), Dtype(0.3),
+        u_.mutable_cpu_data());
+    caffe_rng_gaussian<Dtype>(v_.count(), Dtype(0), Dtype(0.3),
+        v_.mutable_cpu_data());
+  }
+
+  // The N*C*H*W sweep of x_ along its height, or the step-major one when
+  // permuted, which reads the same elements as 5 steps of 6 x 140.
+  IRNNSweep Sweep(const bool permuted, const bool reverse) const {
+    return permuted ? irnn_step_major_sweep(5, channels_, 140, reverse) :
+        irnn_nchw_sweep(2, channels_, 5, 70, x_.count(1), reverse);
+  }
+
+  // Runs the forward and the backward pass of sweep in 'slabs' slabs, one
+  // after the other, with its tile set to 'tile'. The hidden states go to
+  // h, dz to dz and the weight diffs to the diffs of w_, u_ and v_.
+  void Run(const IRNNMathWeights weights, IRNNSweep sweep, const int tile,
+      const int slabs, Blob<Dtype>* h, Blob<Dtype>* dz) {
+    sweep.tile = tile;
+    h->CopyFrom(x_, false, true);
+    dz->ReshapeLike(x_);
+    Blob<Dtype> carry(1, 1, channels_, sweep.length);
+    Blob<Dtype> tmp(1, 1, rank_, sweep.length);
+    Dtype* h_data = h->mutable_cpu_data();
+    for (int slab = 0; slab < slabs; ++slab) {
+      switch (weights) {
+      case IRNN_DENSE:
+        irnn_forward_cpu(sweep, w_.cpu_data(), h_data, slab, slabs);
+        break;
+      case IRNN_LOW_RANK:
+        irnn_forward_cpu(sweep, rank_, u_.cpu_data(), v_.cpu_data(), h_data,
+            tmp.mutable_cpu_data(), slab, slabs);
+        break;
+      case IRNN_DIAGONAL:
+        irnn_diagonal_forward_cpu(sweep, w_.cpu_data(), h_data, slab, slabs);
+        break;
+      }
+    }
+    Dtype* dz_data = dz->mutable_cpu_data();
+    for (int slab = 0; slab < slabs; ++slab) {
+      switch (weights) {
+      case IRNN_DENSE:
+        irnn_backward_chain_cpu(sweep, w_.cpu_data(), h_data,
+            top_diff_.cpu_data(), dz_data, carry.mutable_cpu_data(), slab,
+            slabs);
+        break;
+      case IRNN_LOW_RANK:
+        irnn_backward_chain_cpu(sweep, rank_, u_.cpu_data(), v_.cpu_data(),
+            h_data, top_diff_.cpu_data(), dz_data, carry.mutable_cpu_data(),
+            tmp.mutable_cpu_data(), slab, slabs);
+        break;
+      case IRNN_DIAGONAL:
+        irnn_diagonal_backward_chain_cpu(sweep, w_.cpu_data(), h_data,
+            top_diff_.cpu_data(), dz_data, carry.mutable_cpu_data(), slab,
+            slabs);
+        break;
+      }
+    }
+    caffe_set(w_.count(), Dtype(0), w_.mutable_cpu_diff());
+    caffe_set(u_.count(), Dtype(0), u_.mutable_cpu_diff());
+    caffe_set(v_.count(), Dtype(0), v_.mutable_cpu_diff());
+    switch (weights) {
+    case IRNN_DENSE:
+      irnn_weight_diff_cpu(sweep, h_data, dz_data, w_.mutable_cpu_diff());
+      break;
+    case IRNN_LOW_RANK:
+      irnn_weight_diff_cpu(sweep, rank_, u_.cpu_data(), v_.cpu_data(),
+          h_data, dz_data, tmp.mutable_cpu_data(), u_.mutable_cpu_diff(),
+          v_.mutable_cpu_diff());
+      break;
+    case IRNN_DIAGONAL:
+      irnn_diagonal_weight_diff_cpu(sweep, h_data, dz_data,
+          w_.mutable_cpu_diff());
+      break;
+    }
+  }
+
+  static void ExpectNear(const int count, const Dtype* expected,
+      const Dtype* actual) {
+    for (int i = 0; i < count; ++i) {
+      const Dtype tol = Dtype(1e-4) * std::max(Dtype(1),
+          std::fabs(expected[i]));
+      EXPECT_NEAR(expected[i], actual[i], tol) << "element " << i;
+    }
+  }
+
+  // Every cut into slabs and tiles against the whole sweep at once.
+  void TestCuts(const IRNNMathWeights weights, const bool permuted) {
+    for (int reverse = 0; reverse < 2; ++reverse) {
+      const IRNNSweep sweep = Sweep(permuted, reverse);
+      Blob<Dtype> h;
+      Blob<Dtype> dz;
+      Run(weights, sweep, sweep.length, 1, &h, &dz);
+      Blob<Dtype> w_diff;
+      Blob<Dtype> u_diff;
+      Blob<Dtype> v_diff;
+      w_diff.CopyFrom(w_, true, true);
+      u_diff.CopyFrom(u_, true, true);
+      v_diff.CopyFrom(v_, true, true);
+      // tiles that do and do not divide the slabs, and the slabs of 4
+      // workers, several at these lengths
+      const int tiles[] = {sweep.length, 8, 5};
+      const int slabs[] = {1, 3, irnn_cpu_slabs(sweep, 4)};
+      for (int t = 0; t < 3; ++t) {
+        for (int s = 0; s < 3; ++s) {
+          Blob<Dtype> cut_h;
+          Blob<Dtype> cut_dz;
+          Run(weights, sweep, tiles[t], slabs[s], &cut_h, &cut_dz);
+          SCOPED_TRACE(testing::Message() << "tile " << tiles[t] << ", "
+              << slabs[s] << " slabs, reverse " << reverse);
+          ExpectNear(h.count(), h.cpu_data(), cut_h.cpu_data());
+          ExpectNear(dz.count(), dz.cpu_data(), cut_dz.cpu_data());
+          ExpectNear(w_.count(), w_diff.cpu_diff(), w_.cpu_diff());
+          ExpectNear(u_.count(), u_diff.cpu_diff(), u_.cpu_diff());
+          ExpectNear(v_.count(), v_diff.cpu_diff(), v_.cpu_diff());
+        }
+      }
+    }
+  }
+
+  const int channels_;
+  const int rank_;
+  Blob<Dtype> x_;
+  Blob<Dtype> top_diff_;
+  Blob<Dtype> w_;
+  Blob<Dtype> u_;
+  Blob<Dtype> v_;
+};
+
+TYPED_TEST_CASE(IRNNMathTest, TestDtypes);
+
+TYPED_TEST(IRNNMathTest, TestSlabs) {
+  const IRNNSweep sweep = this->Sweep(false, false);
+  EXPECT_EQ(1, irnn_cpu_slabs(sweep, 1));
+  EXPECT_EQ(4, irnn_cpu_slabs(sweep, 4));
+  // no slab narrower than 16 lines
+  EXPECT_EQ(4, irnn_cpu_slabs(sweep, 8));
+  EXPECT_EQ(8, irnn_cpu_slabs(this->Sweep(true, false), 8));
+  IRNNSweep narrow = sweep;
+  narrow.length = 15;
+  EXPECT_EQ(1, irnn_cpu_slabs(narrow, 8));
+}
+
+TYPED_TEST(IRNNMathTest, TestTile) {
+  typedef TypeParam Dtype;
+  IRNNSweep sweep = irnn_nchw_sweep(1, 16, 4, 1 << 24, 0, false);
+  const int tile = irnn_cpu_tile<Dtype>(sweep);
+  EXPECT_LT(tile, sweep.length);
+  EXPECT_GE(tile, 16);
+  EXPECT_EQ(0, tile % 8);
+  sweep.length = 40;
+  EXPECT_EQ(40, irnn_cpu_tile<Dtype>(sweep));
+  // W alone fills the cache
+  IRNNSweep wide = irnn_nchw_sweep(1, 1 << 14, 4, 1 << 24, 0, false);
+  EXPECT_EQ(wide.length, irnn_cpu_tile<Dtype>(wide));
+}
+
+TYPED_TEST(IRNNMathTest, TestCutsDense) {
+  this->TestCuts(IRNN_DENSE, false);
+  this->TestCuts(IRNN_DENSE, true);
+}
+
+TYPED_TEST(IRNNMathTest, TestCutsLowRank) {
+  this->TestCuts(IRNN_LOW_RANK, false);
+  this->TestCuts(IRNN_LOW_RANK, true);
+}
+
+TYPED_TEST(IRNNMathTest, TestCutsDiagonal) {
+  this->TestCuts(IRNN_DIAGONAL, false);
+  this->TestCuts(IRNN_DIAGONAL, true);
+}
+
+}  // namespace caffe
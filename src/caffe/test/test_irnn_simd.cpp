@@ -0,0 +1,128 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <string.h>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/irnn_simd.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Every instruction set has to give the scalar loops bit for bit, NaN and
+// -0 included, on rows of any length and alignment.
+class IRNNSimdTest : public ::testing::Test {
+ protected:
+  IRNNSimdTest() : isa_(irnn_simd_isa()) {}
+  virtual ~IRNNSimdTest() {
+    // back to the pick for the host
+    irnn_simd_set_isa(isa_);
+  }
+
+  // n + 2 uniform values in [-1, 1] with NaN, -0, 0 and infinities mixed
+  // in: a row of n between two guards the kernels must not touch.
+  static vector<float> Values(const int n) {
+    vector<float> values(n + 2);
+    caffe_rng_uniform<float>(n + 2, -1.f, 1.f, &values[0]);
+    const float special[] = {std::numeric_limits<float>::quiet_NaN(), -0.f,
+        0.f, std::numeric_limits<float>::infinity(),
+        -std::numeric_limits<float>::infinity()};
+    for (int i = 0; i < n + 2; i += 3) {
+      values[i] = special[(i / 3) % 5];
+    }
+    return values;
+  }
+
+  static void ExpectSameBits(const vector<float>& expected,
+      const vector<float>& actual, const string& kernel, const int n) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(0, memcmp(&expected[i], &actual[i], sizeof(float)))
+          << kernel << " on " << n << " elements, at " << i << ": "
+          << expected[i] << " vs " << actual[i];
+    }
+  }
+
+  // Runs the four kernels with isa and with the scalar loops on rows of n
+  // elements, starting one element into the vectors so that the rows are
+  // not aligned.
+  static void TestKernels(const string& isa, const int n) {
+    const float alpha = -0.75f;
+    const vector<float> x = Values(n);
+    const vector<float> a = Values(n);
+    const vector<float> top_diff = Values(n);
+    const vector<float> carry = Values(n);
+    const vector<float> h = Values(n);
+    vector<float> expected[5];
+    vector<float> actual[5];
+    for (int pass = 0; pass < 2; ++pass) {
+      ASSERT_TRUE(irnn_simd_set_isa(pass == 0 ? "scalar" : isa));
+      vector<float>* out = pass == 0 ? expected : actual;
+      out[0] = x;
+      irnn_relu_cpu(n, &out[0][1]);
+      out[1] = x;
+      irnn_axpy_relu_cpu(n, alpha, &a[1], &out[1][1]);
+      out[2] = x;
+      irnn_relu_grad_cpu(n, &top_diff[1], &carry[1], &h[1], &out[2][1]);
+      out[3] = x;
+      out[4] = carry;
+      irnn_relu_grad_scale_cpu(n, alpha, &top_diff[1], &out[4][1], &h[1],
+          &out[3][1]);
+    }
+    ExpectSameBits(expected[0], actual[0], isa + " relu", n);
+    ExpectSameBits(expected[1], actual[1], isa + " axpy_relu", n);
+    ExpectSameBits(expected[2], actual[2], isa + " relu_grad", n);
+    ExpectSameBits(expected[3], actual[3], isa + " relu_grad_scale dz", n);
+    ExpectSameBits(expected[4], actual[4], isa + " relu_grad_scale carry",
+        n);
+  }
+
+  const string isa_;
+};
+
+TEST_F(IRNNSimdTest, TestISAs) {
+  const char* isas[] = {"avx512", "avx2", "sse2"};
+  for (int i = 0; i < 3; ++i) {
+    if (!irnn_simd_set_isa(isas[i])) {
+      LOG(INFO) << "Skipping " << isas[i] << ", not run by this host";
+      continue;
+    }
+    // below, at and past one vector of 4, 8 and 16, and longer rows with
+    // a tail
+    for (int n = 0; n <= 40; ++n) {
+      TestKernels(isas[i], n);
+    }
+    TestKernels(isas[i], 1023);
+  }
+}
+
+// The scalar relu keeps NaN and -0, which the vector kernels must match.
+TEST_F(IRNNSimdTest, TestScalarReLU) {
+  ASSERT_TRUE(irnn_simd_set_isa("scalar"));
+  float x[3] = {std::numeric_limits<float>::quiet_NaN(), -0.f, -1.f};
+  irnn_relu_cpu(3, x);
+  EXPECT_TRUE(x[0] != x[0]);
+  EXPECT_EQ(0, memcmp(&x[1], "\0\0\0\x80", sizeof(float)));
+  EXPECT_EQ(0.f, x[2]);
+}
+
+TEST_F(IRNNSimdTest, TestSetISA) {
+  EXPECT_TRUE(irnn_simd_set_isa("scalar"));
+  EXPECT_EQ(string("scalar"), irnn_simd_isa());
+  EXPECT_FALSE(irnn_simd_set_isa("sse9"));
+  EXPECT_EQ(string("scalar"), irnn_simd_isa());
+}
+
+}  // namespace caffe
@@ -0,0 +1,775 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/spatial_irnn_layer.hpp"
+#include "caffe/util/irnn_workspace.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SpatialIRNNLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SpatialIRNNLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 4, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~SpatialIRNNLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  // Checks that concat is the concat of the left, right, down and up layers
+  // run on input with the recurrent weights of spatial_irnn.
+  void CheckDirections(const vector<Blob<Dtype>*>& input,
+      Layer<Dtype>* spatial_irnn, const Blob<Dtype>& concat) {
+    LayerParameter left_param;
+    left_param.mutable_rnn_left_param()->set_axis(3);
+    LayerParameter right_param;
+    right_param.mutable_rnn_right_param()->set_axis(3);
+    LayerParameter down_param;
+    down_param.mutable_rnn_down_param()->set_axis(2);
+    LayerParameter up_param;
+    up_param.mutable_rnn_up_param()->set_axis(2);
+    shared_ptr<Layer<Dtype> > directions[4] = {
+        shared_ptr<Layer<Dtype> >(new RNNLEFTLayer<Dtype>(left_param)),
+        shared_ptr<Layer<Dtype> >(new RNNRIGHTLayer<Dtype>(right_param)),
+        shared_ptr<Layer<Dtype> >(new RNNDOWNLayer<Dtype>(down_param)),
+        shared_ptr<Layer<Dtype> >(new RNNUPLayer<Dtype>(up_param))};
+    const int C = input[0]->channels();
+    ASSERT_EQ(4 * C, concat.channels());
+    for (int d = 0; d < 4; ++d) {
+      Blob<Dtype> top;
+      vector<Blob<Dtype>*> top_vec(1, &top);
+      directions[d]->blobs().push_back(spatial_irnn->blobs()[d]);
+      directions[d]->SetUp(input, top_vec);
+      directions[d]->Forward(input, top_vec);
+      for (int n = 0; n < top.num(); ++n) {
+        for (int c = 0; c < C; ++c) {
+          for (int h = 0; h < top.height(); ++h) {
+            for (int w = 0; w < top.width(); ++w) {
+              EXPECT_NEAR(top.data_at(n, c, h, w),
+                  concat.data_at(n, d * C + c, h, w), 1e-4);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Checks that with num_output the top of phase is that of the layer
+  // without it followed by a 1x1 convolution with the same weights and
+  // bias. The TEST phase keeps the concat in the workspace rather than in
+  // a blob of its own.
+  void TestForwardProjection(const Phase phase) {
+    LayerParameter layer_param;
+    layer_param.set_phase(phase);
+    SpatialIRNNParameter* spatial_irnn_param =
+        layer_param.mutable_spatial_irnn_param();
+    spatial_irnn_param->mutable_weight_filler()->set_type("gaussian");
+    spatial_irnn_param->mutable_weight_filler()->set_std(0.3);
+    LayerParameter projected_param(layer_param);
+    spatial_irnn_param = projected_param.mutable_spatial_irnn_param();
+    spatial_irnn_param->set_num_output(7);
+    spatial_irnn_param->mutable_projection_filler()->set_type("gaussian");
+    spatial_irnn_param->mutable_projection_filler()->set_std(0.3);
+    spatial_irnn_param->mutable_bias_filler()->set_type("gaussian");
+    spatial_irnn_param->mutable_bias_filler()->set_std(0.3);
+    SpatialIRNNLayer<Dtype> projected_layer(projected_param);
+    projected_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(projected_layer.blobs().size(), 6);
+    EXPECT_EQ(this->blob_top_->channels(), 7);
+    projected_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+    SpatialIRNNLayer<Dtype> layer(layer_param);
+    Blob<Dtype> concat;
+    vector<Blob<Dtype>*> concat_vec(1, &concat);
+    layer.SetUp(this->blob_bottom_vec_, concat_vec);
+    for (int d = 0; d < 4; ++d) {
+      layer.blobs()[d]->CopyFrom(*projected_layer.blobs()[d]);
+    }
+    layer.Forward(this->blob_bottom_vec_, concat_vec);
+    LayerParameter conv_param;
+    conv_param.mutable_convolution_param()->set_num_output(7);
+    conv_param.mutable_convolution_param()->add_kernel_size(1);
+    ConvolutionLayer<Dtype> conv(conv_param);
+    Blob<Dtype> top;
+    vector<Blob<Dtype>*> top_vec(1, &top);
+    conv.SetUp(concat_vec, top_vec);
+    conv.blobs()[0]->CopyFrom(*projected_layer.blobs()[4]);
+    conv.blobs()[1]->CopyFrom(*projected_layer.blobs()[5]);
+    conv.Forward(concat_vec, top_vec);
+    ASSERT_EQ(top.count(), this->blob_top_->count());
+    for (int i = 0; i < top.count(); ++i) {
+      EXPECT_NEAR(top.cpu_data()[i], this->blob_top_->cpu_data()[i], 1e-4);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SpatialIRNNLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SpatialIRNNLayerTest, TestSetUp) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SpatialIRNNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), 2);
+  EXPECT_EQ(this->blob_top_->channels(), 12);
+  EXPECT_EQ(this->blob_top_->height(), 4);
+  EXPECT_EQ(this->blob_top_->width(), 5);
+  EXPECT_EQ(layer.blobs().size(), 4);
+}
+
+// The top is the concat of the left, right, down and up layers run on the
+// same bottom with the same weights.
+TYPED_TEST(SpatialIRNNLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  FillerParameter* weight_filler =
+      layer_param.mutable_spatial_irnn_param()->mutable_weight_filler();
+  weight_filler->set_type("gaussian");
+  weight_filler->set_std(0.3);
+  SpatialIRNNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckDirections(this->blob_bottom_vec_, &layer, *this->blob_top_);
+}
+
+// With num_hidden, the directions run on the output of the 1x1 convolution
+// the input projection replaces.
+TYPED_TEST(SpatialIRNNLayerTest, TestForwardNumHidden) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SpatialIRNNParameter* spatial_irnn_param =
+      layer_param.mutable_spatial_irnn_param();
+  spatial_irnn_param->mutable_weight_filler()->set_type("gaussian");
+  spatial_irnn_param->mutable_weight_filler()->set_std(0.3);
+  spatial_irnn_param->set_num_hidden(5);
+  spatial_irnn_param->mutable_input_filler()->set_type("gaussian");
+  spatial_irnn_param->mutable_input_filler()->set_std(0.5);
+  spatial_irnn_param->mutable_input_bias_filler()->set_type("gaussian");
+  spatial_irnn_param->mutable_input_bias_filler()->set_std(0.5);
+  SpatialIRNNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(layer.blobs().size(), 6);
+  EXPECT_EQ(this->blob_top_->channels(), 20);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  LayerParameter conv_param;
+  conv_param.mutable_convolution_param()->set_num_output(5);
+  conv_param.mutable_convolution_param()->add_kernel_size(1);
+  ConvolutionLayer<Dtype> conv(conv_param);
+  Blob<Dtype> projected;
+  vector<Blob<Dtype>*> projected_vec(1, &projected);
+  conv.SetUp(this->blob_bottom_vec_, projected_vec);
+  conv.blobs()[0]->CopyFrom(*layer.blobs()[4]);
+  conv.blobs()[1]->CopyFrom(*layer.blobs()[5]);
+  conv.Forward(this->blob_bottom_vec_, projected_vec);
+  this->CheckDirections(projected_vec, &layer, *this->blob_top_);
+}
+
+TYPED_TEST(SpatialIRNNLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  // As for the directional layers, inputs at least 1/3 away from zero and
+  // small weights keep the pre-activations clear of the ReLU kink.
+  Dtype* x = this->blob_bottom_->mutable_cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    x[i] = (x[i] + (x[i] < 0 ? Dtype(-0.5) : Dtype(0.5))) / Dtype(1.5);
+  }
+  LayerParameter layer_param;
+  FillerParameter* weight_filler =
+      layer_param.mutable_spatial_irnn_param()->mutable_weight_filler();
+  weight_filler->set_type("uniform");
+  weight_filler->set_min(-0.05);
+  weight_filler->set_max(0.05);
+  SpatialIRNNLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(SpatialIRNNLayerTest, TestForwardProjectionTrain) {
+  this->TestForwardProjection(TRAIN);
+}
+
+TYPED_TEST(SpatialIRNNLayerTest, TestForwardProjectionTest) {
+  this->TestForwardProjection(TEST);
+}
+
+// The gradients of the output projection and its bias as well. The
+// projection hides the hidden states from the checker, which are kept
+// clear of the ReLU kink as in TestGradient.
+TYPED_TEST(SpatialIRNNLayerTest, TestGradientProjection) {
+  typedef typename TypeParam::Dtype Dtype;
+  Dtype* x = this->blob_bottom_->mutable_cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    x[i] = (x[i] + (x[i] < 0 ? Dtype(-0.5) : Dtype(0.5))) / Dtype(1.5);
+  }
+  LayerParameter layer_param;
+  SpatialIRNNParameter* spatial_irnn_param =
+      layer_param.mutable_spatial_irnn_param();
+  spatial_irnn_param->mutable_weight_filler()->set_type("uniform");
+  spatial_irnn_param->mutable_weight_filler()->set_min(-0.05);
+  spatial_irnn_param->mutable_weight_filler()->set_max(0.05);
+  spatial_irnn_param->set_num_output(3);
+  spatial_irnn_param->mutable_projection_filler()->set_type("gaussian");
+  spatial_irnn_param->mutable_projection_filler()->set_std(0.3);
+  spatial_irnn_param->mutable_bias_filler()->set_type("gaussian");
+  spatial_irnn_param->mutable_bias_filler()->set_std(0.3);
+  SpatialIRNNLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+// The gradients of the input projection and its bias as well, with fewer
+// hidden channels than the bottom has. With a positive bottom, the
+// projection keeps the first hidden channel well above the ReLU kink and
+// the second well below it.
+TYPED_TEST(SpatialIRNNLayerTest, TestGradientNumHidden) {
+  typedef typename TypeParam::Dtype Dtype;
+  Dtype* x = this->blob_bottom_->mutable_cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    x[i] = (std::fabs(x[i]) + Dtype(0.5)) / Dtype(1.5);
+  }
+  LayerParameter layer_param;
+  SpatialIRNNParameter* spatial_irnn_param =
+      layer_param.mutable_spatial_irnn_param();
+  spatial_irnn_param->mutable_weight_filler()->set_type("uniform");
+  spatial_irnn_param->mutable_weight_filler()->set_min(-0.05);
+  spatial_irnn_param->mutable_weight_filler()->set_max(0.05);
+  spatial_irnn_param->set_num_hidden(2);
+  spatial_irnn_param->mutable_input_filler()->set_type("uniform");
+  spatial_irnn_param->mutable_input_filler()->set_min(0.2);
+  spatial_irnn_param->mutable_input_filler()->set_max(0.6);
+  spatial_irnn_param->mutable_input_bias_filler()->set_value(0.1);
+  ASSERT_TRUE(spatial_irnn_param->input_bias_term());
+  SpatialIRNNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(layer.blobs().size(), 6);
+  const int C = this->blob_bottom_->channels();
+  Dtype* input_w = layer.blobs()[4]->mutable_cpu_data();
+  caffe_scal(C, Dtype(-1), input_w + C);
+  layer.blobs()[5]->mutable_cpu_data()[1] = Dtype(-0.1);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+// bf16_storage only changes the CPU backward pass.
+template <typename Dtype>
+class IRNNBf16StorageTest : public CPUDeviceTest<Dtype> {
+ protected:
+  IRNNBf16StorageTest()
+      : blob_bottom_(new Blob<Dtype>(2, 16, 6, 7)),
+        blob_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~IRNNBf16StorageTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  // Largest difference of a and b relative to the largest magnitude of b.
+  static Dtype RelativeError(const Blob<Dtype>& a, const Blob<Dtype>& b,
+      const bool diff) {
+    const Dtype* a_data = diff ? a.cpu_diff() : a.cpu_data();
+    const Dtype* b_data = diff ? b.cpu_diff() : b.cpu_data();
+    Dtype error = 0;
+    Dtype scale = 0;
+    for (int i = 0; i < b.count(); ++i) {
+      error = std::max(error, std::fabs(a_data[i] - b_data[i]));
+      scale = std::max(scale, std::fabs(b_data[i]));
+    }
+    return error / scale;
+  }
+
+  // Runs the layer of float_param and the same layer with bf16_storage on
+  // the same bottom, weights and top diff, and checks that the bottom and
+  // weight diffs of the latter are within 1e-2 of the former.
+  void TestBackward(const LayerParameter& float_param,
+      const LayerParameter& bf16_param) {
+    shared_ptr<Layer<Dtype> > float_layer =
+        LayerRegistry<Dtype>::CreateLayer(float_param);
+    shared_ptr<Layer<Dtype> > bf16_layer =
+        LayerRegistry<Dtype>::CreateLayer(bf16_param);
+    Blob<Dtype> bf16_bottom;
+    bf16_bottom.CopyFrom(*this->blob_bottom_, false, true);
+    Blob<Dtype> bf16_top;
+    vector<Blob<Dtype>*> bf16_bottom_vec(1, &bf16_bottom);
+    vector<Blob<Dtype>*> bf16_top_vec(1, &bf16_top);
+    float_layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    bf16_layer->SetUp(bf16_bottom_vec, bf16_top_vec);
+    ASSERT_EQ(float_layer->blobs().size(), bf16_layer->blobs().size());
+    for (int i = 0; i < float_layer->blobs().size(); ++i) {
+      bf16_layer->blobs()[i]->CopyFrom(*float_layer->blobs()[i]);
+    }
+    float_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    bf16_layer->Forward(bf16_bottom_vec, bf16_top_vec);
+
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*this->blob_top_);
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        bf16_top.mutable_cpu_diff());
+    const vector<bool> propagate_down(1, true);
+    float_layer->Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    bf16_layer->Backward(bf16_top_vec, propagate_down, bf16_bottom_vec);
+
+    EXPECT_LE(RelativeError(bf16_top, *this->blob_top_, false), 1e-6);
+    EXPECT_LE(RelativeError(bf16_bottom, *this->blob_bottom_, true), 1e-2);
+    for (int i = 0; i < float_layer->blobs().size(); ++i) {
+      EXPECT_LE(RelativeError(*bf16_layer->blobs()[i],
+          *float_layer->blobs()[i], true), 1e-2) << "blob " << i;
+    }
+  }
+
+  // Runs a forward and a backward pass of the layer of param on bottom and
+  // sets bytes to the workspace they borrowed. As in irnn_benchmark, the
+  // passes run on a thread of their own, whose workspace starts empty.
+  static void RunPasses(const LayerParameter& param,
+      const Blob<Dtype>* bottom, size_t* bytes) {
+    shared_ptr<Layer<Dtype> > layer =
+        LayerRegistry<Dtype>::CreateLayer(param);
+    Blob<Dtype> layer_bottom;
+    layer_bottom.CopyFrom(*bottom, false, true);
+    Blob<Dtype> top;
+    vector<Blob<Dtype>*> bottom_vec(1, &layer_bottom);
+    vector<Blob<Dtype>*> top_vec(1, &top);
+    layer->SetUp(bottom_vec, top_vec);
+    layer->Forward(bottom_vec, top_vec);
+    caffe_set(top.count(), Dtype(1), top.mutable_cpu_diff());
+    layer->Backward(top_vec, vector<bool>(1, true), bottom_vec);
+    *bytes = IRNNWorkspace::Get().capacity();
+  }
+
+  // Checks that the layer of bf16_param borrows less workspace than that of
+  // float_param, which holds a Dtype copy of the hidden diffs on top of the
+  // hidden states.
+  void TestScratch(const LayerParameter& float_param,
+      const LayerParameter& bf16_param) {
+    size_t float_bytes = 0;
+    size_t bf16_bytes = 0;
+    boost::thread float_thread(&IRNNBf16StorageTest<Dtype>::RunPasses,
+        boost::cref(float_param), this->blob_bottom_, &float_bytes);
+    float_thread.join();
+    boost::thread bf16_thread(&IRNNBf16StorageTest<Dtype>::RunPasses,
+        boost::cref(bf16_param), this->blob_bottom_, &bf16_bytes);
+    bf16_thread.join();
+    EXPECT_GT(bf16_bytes, 0);
+    EXPECT_LT(bf16_bytes, float_bytes);
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(IRNNBf16StorageTest, TestDtypes);
+
+TYPED_TEST(IRNNBf16StorageTest, TestSpatialIRNN) {
+  LayerParameter float_param;
+  float_param.set_type("SpatialIRNN");
+  FillerParameter* weight_filler =
+      float_param.mutable_spatial_irnn_param()->mutable_weight_filler();
+  weight_filler->set_type("gaussian");
+  weight_filler->set_std(0.1);
+  LayerParameter bf16_param(float_param);
+  bf16_param.mutable_spatial_irnn_param()->set_bf16_storage(true);
+  this->TestBackward(float_param, bf16_param);
+}
+
+TYPED_TEST(IRNNBf16StorageTest, TestSpatialIRNNProjected) {
+  LayerParameter float_param;
+  float_param.set_type("SpatialIRNN");
+  SpatialIRNNParameter* spatial_irnn_param =
+      float_param.mutable_spatial_irnn_param();
+  spatial_irnn_param->mutable_weight_filler()->set_type("gaussian");
+  spatial_irnn_param->mutable_weight_filler()->set_std(0.1);
+  spatial_irnn_param->set_num_output(8);
+  spatial_irnn_param->mutable_projection_filler()->set_type("gaussian");
+  spatial_irnn_param->mutable_projection_filler()->set_std(0.1);
+  LayerParameter bf16_param(float_param);
+  bf16_param.mutable_spatial_irnn_param()->set_bf16_storage(true);
+  this->TestBackward(float_param, bf16_param);
+}
+
+TYPED_TEST(IRNNBf16StorageTest, TestRNNLEFT) {
+  LayerParameter float_param;
+  float_param.set_type("RNNLEFT");
+  float_param.mutable_rnn_left_param()->set_axis(3);
+  float_param.mutable_rnn_left_param()->mutable_weight_filler()->set_type(
+      "gaussian");
+  float_param.mutable_rnn_left_param()->mutable_weight_filler()->set_std(0.1);
+  LayerParameter bf16_param(float_param);
+  bf16_param.mutable_rnn_left_param()->set_bf16_storage(true);
+  this->TestBackward(float_param, bf16_param);
+}
+
+TYPED_TEST(IRNNBf16StorageTest, TestRNNRIGHT) {
+  LayerParameter float_param;
+  float_param.set_type("RNNRIGHT");
+  float_param.mutable_rnn_right_param()->set_axis(3);
+  float_param.mutable_rnn_right_param()->mutable_weight_filler()->set_type(
+      "gaussian");
+  float_param.mutable_rnn_right_param()->mutable_weight_filler()->set_std(
+      0.1);
+  LayerParameter bf16_param(float_param);
+  bf16_param.mutable_rnn_right_param()->set_bf16_storage(true);
+  this->TestBackward(float_param, bf16_param);
+}
+
+TYPED_TEST(IRNNBf16StorageTest, TestScratch) {
+  LayerParameter spatial_irnn_param;
+  spatial_irnn_param.set_type("SpatialIRNN");
+  LayerParameter spatial_irnn_bf16_param(spatial_irnn_param);
+  spatial_irnn_bf16_param.mutable_spatial_irnn_param()->set_bf16_storage(
+      true);
+  this->TestScratch(spatial_irnn_param, spatial_irnn_bf16_param);
+
+  LayerParameter left_param;
+  left_param.set_type("RNNLEFT");
+  left_param.mutable_rnn_left_param()->set_axis(3);
+  LayerParameter left_bf16_param(left_param);
+  left_bf16_param.mutable_rnn_left_param()->set_bf16_storage(true);
+  this->TestScratch(left_param, left_bf16_param);
+
+  LayerParameter right_param;
+  right_param.set_type("RNNRIGHT");
+  right_param.mutable_rnn_right_param()->set_axis(3);
+  LayerParameter right_bf16_param(right_param);
+  right_bf16_param.mutable_rnn_right_param()->set_bf16_storage(true);
+  this->TestScratch(right_param, right_bf16_param);
+}
+
+// The layers must not read scratch they have not written: passes on a
+// workspace filled with NaN give the same tops and diffs as passes on a
+// zeroed one.
+template <typename Dtype>
+class IRNNWorkspaceTest : public CPUDeviceTest<Dtype> {
+ protected:
+  IRNNWorkspaceTest()
+      : blob_bottom_(new Blob<Dtype>(2, 6, 5, 7)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_diff_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~IRNNWorkspaceTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_diff_;
+  }
+
+  // Fills all of the workspace of this thread with value.
+  static void FillWorkspace(const Dtype value) {
+    IRNNWorkspace& workspace = IRNNWorkspace::Get();
+    const size_t count = workspace.capacity() / sizeof(Dtype);
+    Dtype* data = static_cast<Dtype*>(workspace.Borrow(count * sizeof(Dtype)));
+    std::fill(data, data + count, value);
+  }
+
+  // Forward and, unless the layer runs in the TEST phase, backward passes of
+  // layer on a workspace filled with value. The top is copied to top, the
+  // bottom and weight diffs to diffs.
+  void RunPasses(Layer<Dtype>* layer, const Dtype value, Blob<Dtype>* top,
+      vector<shared_ptr<Blob<Dtype> > >* diffs) {
+    FillWorkspace(value);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    top->CopyFrom(*this->blob_top_, false, true);
+    diffs->clear();
+    if (layer->layer_param().phase() == TEST) {
+      return;
+    }
+    caffe_copy(blob_top_diff_->count(), blob_top_diff_->cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      caffe_set(layer->blobs()[i]->count(), Dtype(0),
+          layer->blobs()[i]->mutable_cpu_diff());
+    }
+    FillWorkspace(value);
+    layer->Backward(this->blob_top_vec_, vector<bool>(1, true),
+        this->blob_bottom_vec_);
+    diffs->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    diffs->back()->CopyFrom(*this->blob_bottom_, true, true);
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      diffs->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      diffs->back()->CopyFrom(*layer->blobs()[i], true, true);
+    }
+  }
+
+  void TestWorkspace(const string& proto) {
+    LayerParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    shared_ptr<Layer<Dtype> > layer = LayerRegistry<Dtype>::CreateLayer(param);
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    blob_top_diff_->ReshapeLike(*this->blob_top_);
+    filler.Fill(blob_top_diff_);
+    // the first passes grow the workspace to what the layer borrows
+    Blob<Dtype> top;
+    vector<shared_ptr<Blob<Dtype> > > diffs;
+    RunPasses(layer.get(), Dtype(0), &top, &diffs);
+    RunPasses(layer.get(), Dtype(0), &top, &diffs);
+    Blob<Dtype> nan_top;
+    vector<shared_ptr<Blob<Dtype> > > nan_diffs;
+    RunPasses(layer.get(), std::numeric_limits<Dtype>::quiet_NaN(), &nan_top,
+        &nan_diffs);
+    for (int i = 0; i < top.count(); ++i) {
+      ASSERT_EQ(top.cpu_data()[i], nan_top.cpu_data()[i]) << proto;
+    }
+    ASSERT_EQ(diffs.size(), nan_diffs.size());
+    for (int j = 0; j < diffs.size(); ++j) {
+      for (int i = 0; i < diffs[j]->count(); ++i) {
+        ASSERT_EQ(diffs[j]->cpu_diff()[i], nan_diffs[j]->cpu_diff()[i])
+            << proto << " diff " << j;
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_diff_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(IRNNWorkspaceTest, TestDtypes);
+
+TYPED_TEST(IRNNWorkspaceTest, TestDirectional) {
+  const char* modes[] = {"", "rank: 2", "recurrence: DIAGONAL", "group: 2",
+      "bf16_storage: true"};
+  for (int i = 0; i < 5; ++i) {
+    const string weight_filler =
+        " weight_filler { type: 'gaussian' std: 0.2 } ";
+    this->TestWorkspace("type: 'RNNLEFT' rnn_left_param { axis: 3 " +
+        string(modes[i]) + weight_filler + "}");
+    this->TestWorkspace("type: 'RNNDOWN' rnn_down_param { axis: 2 " +
+        string(modes[i]) + weight_filler + "}");
+  }
+}
+
+TYPED_TEST(IRNNWorkspaceTest, TestSpatialIRNN) {
+  const char* modes[] = {"", "bf16_storage: true",
+      "num_output: 5 projection_filler { type: 'gaussian' std: 0.2 }",
+      "num_hidden: 4 input_filler { type: 'gaussian' std: 0.2 }"};
+  for (int i = 0; i < 4; ++i) {
+    const string param = "spatial_irnn_param { " + string(modes[i]) +
+        " weight_filler { type: 'gaussian' std: 0.2 } }";
+    this->TestWorkspace("type: 'SpatialIRNN' " + param);
+    // the TEST phase borrows the concat in front of the projection
+    this->TestWorkspace("type: 'SpatialIRNN' phase: TEST " + param);
+  }
+}
+
+// The memory behind blob, which a Reshape that outgrows it replaces.
+template <typename T>
+static const void* BlobMemory(const Blob<T>& blob) {
+  return blob.count() > 0 ? blob.data().get() : NULL;
+}
+
+// A SpatialIRNN layer that shows the buffers it keeps from one pass to the
+// next.
+template <typename Dtype>
+class SpatialIRNNBuffersLayer : public SpatialIRNNLayer<Dtype> {
+ public:
+  explicit SpatialIRNNBuffersLayer(const LayerParameter& param)
+      : SpatialIRNNLayer<Dtype>(param) {}
+  vector<const void*> Buffers() const {
+    vector<const void*> buffers;
+    for (int d = 0; d < 4; ++d) {
+      buffers.push_back(BlobMemory(*this->hh_[d]));
+      buffers.push_back(BlobMemory(*this->trans_[d]));
+    }
+    buffers.push_back(BlobMemory(this->hidden_));
+    buffers.push_back(BlobMemory(this->bias_multiplier_));
+    buffers.push_back(BlobMemory(this->projected_));
+    return buffers;
+  }
+};
+
+// A tracker reshapes the layer to each new crop: cycling through sizes has
+// to give the tops and diffs of layers set up at each size, and must stop
+// growing the layer and the workspace once it has seen the largest.
+template <typename Dtype>
+class SpatialIRNNReshapeTest : public CPUDeviceTest<Dtype> {
+ protected:
+  SpatialIRNNReshapeTest() {
+    const int shapes[3][4] = {{2, 3, 4, 5}, {3, 3, 6, 7}, {1, 3, 7, 3}};
+    for (int i = 0; i < 3; ++i) {
+      bottoms_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+          shapes[i][0], shapes[i][1], shapes[i][2], shapes[i][3])));
+      caffe_rng_uniform<Dtype>(bottoms_[i]->count(), Dtype(-1), Dtype(1),
+          bottoms_[i]->mutable_cpu_data());
+    }
+  }
+
+  // Two forward passes of layer on bottom, as a tracker sees the same crop
+  // twice, then a backward pass with the top diff of that size. result is
+  // set to the top, then to blobs whose diffs are those of the bottom and
+  // the weights.
+  static void Pass(Layer<Dtype>* layer, Blob<Dtype>* bottom,
+      Blob<Dtype>* top, vector<shared_ptr<Blob<Dtype> > >* result) {
+    vector<Blob<Dtype>*> bottom_vec(1, bottom);
+    vector<Blob<Dtype>*> top_vec(1, top);
+    layer->Reshape(bottom_vec, top_vec);
+    layer->Forward(bottom_vec, top_vec);
+    layer->Forward(bottom_vec, top_vec);
+    Dtype* top_diff = top->mutable_cpu_diff();
+    for (int i = 0; i < top->count(); ++i) {
+      top_diff[i] = Dtype(std::sin(0.7 * i + bottom->count()));
+    }
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      Blob<Dtype>* blob = layer->blobs()[i].get();
+      caffe_set(blob->count(), Dtype(0), blob->mutable_cpu_diff());
+    }
+    layer->Backward(top_vec, vector<bool>(1, true), bottom_vec);
+    result->clear();
+    result->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    result->back()->CopyFrom(*top, false, true);
+    result->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    result->back()->CopyFrom(*bottom, true, true);
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      result->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      result->back()->CopyFrom(*layer->blobs()[i], true, true);
+    }
+  }
+
+  // Cycles layer three times through bottoms, on a thread of its own whose
+  // workspace starts empty, and checks every pass against expected.
+  static void RunCycles(SpatialIRNNBuffersLayer<Dtype>* layer,
+      vector<shared_ptr<Blob<Dtype> > >* bottoms,
+      const vector<vector<shared_ptr<Blob<Dtype> > > >* expected) {
+    Blob<Dtype> top;
+    size_t capacity = 0;
+    vector<const void*> buffers;
+    const void* top_memory = NULL;
+    for (int cycle = 0; cycle < 3; ++cycle) {
+      for (int i = 0; i < bottoms->size(); ++i) {
+        vector<shared_ptr<Blob<Dtype> > > result;
+        Pass(layer, (*bottoms)[i].get(), &top, &result);
+        ASSERT_EQ((*expected)[i].size(), result.size());
+        for (int j = 0; j < result.size(); ++j) {
+          const Blob<Dtype>& blob = *(*expected)[i][j];
+          ASSERT_EQ(blob.shape(), result[j]->shape());
+          const Dtype* data = j > 0 ? blob.cpu_diff() : blob.cpu_data();
+          const Dtype* actual = j > 0 ? result[j]->cpu_diff() :
+              result[j]->cpu_data();
+          for (int k = 0; k < blob.count(); ++k) {
+            EXPECT_NEAR(data[k], actual[k], 1e-5) << "cycle " << cycle
+                << ", size " << i << ", blob " << j << ", element " << k;
+          }
+        }
+      }
+      if (cycle == 0) {
+        capacity = IRNNWorkspace::Get().capacity();
+        buffers = layer->Buffers();
+        top_memory = BlobMemory(top);
+      } else {
+        EXPECT_EQ(capacity, IRNNWorkspace::Get().capacity());
+        EXPECT_TRUE(buffers == layer->Buffers()) << "cycle " << cycle;
+        EXPECT_EQ(top_memory, BlobMemory(top));
+      }
+    }
+  }
+
+  void TestReshapeCycles(const string& proto) {
+    SCOPED_TRACE(proto);
+    LayerParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    SpatialIRNNBuffersLayer<Dtype> layer(param);
+    Blob<Dtype> top;
+    layer.SetUp(vector<Blob<Dtype>*>(1, bottoms_[0].get()),
+        vector<Blob<Dtype>*>(1, &top));
+    vector<vector<shared_ptr<Blob<Dtype> > > > expected(3);
+    for (int i = 0; i < 3; ++i) {
+      SpatialIRNNLayer<Dtype> fresh(param);
+      Blob<Dtype> fresh_top;
+      fresh.SetUp(vector<Blob<Dtype>*>(1, bottoms_[i].get()),
+          vector<Blob<Dtype>*>(1, &fresh_top));
+      for (int j = 0; j < fresh.blobs().size(); ++j) {
+        fresh.blobs()[j]->CopyFrom(*layer.blobs()[j]);
+      }
+      Pass(&fresh, bottoms_[i].get(), &fresh_top, &expected[i]);
+    }
+    boost::thread thread(&SpatialIRNNReshapeTest<Dtype>::RunCycles, &layer,
+        &bottoms_, &expected);
+    thread.join();
+  }
+
+  // the largest in the middle
+  vector<shared_ptr<Blob<Dtype> > > bottoms_;
+};
+
+TYPED_TEST_CASE(SpatialIRNNReshapeTest, TestDtypes);
+
+TYPED_TEST(SpatialIRNNReshapeTest, TestReshapeCycles) {
+  const char* modes[] = {"", "memoize: true", "bf16_storage: true",
+      "num_output: 5 projection_filler { type: 'gaussian' std: 0.2 } "
+      "bias_filler { type: 'gaussian' std: 0.2 }",
+      "num_hidden: 4 input_filler { type: 'gaussian' std: 0.2 }"};
+  for (int i = 0; i < 5; ++i) {
+    this->TestReshapeCycles("type: 'SpatialIRNN' spatial_irnn_param { " +
+        string(modes[i]) + " weight_filler { type: 'gaussian' std: 0.2 } }");
+  }
+}
+
+}  // namespace caffe
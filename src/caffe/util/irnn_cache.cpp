@@ -0,0 +1,258 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/irnn_cache.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Bytes hashed by one thread at a time. The fingerprint of a buffer
+// combines those of its chunks in order, so it does not depend on the
+// number of threads.
+static const size_t kIRNNHashChunkBytes = 64 * 1024;
+// Chunks hashed by one parallel region.
+static const int kIRNNHashRoundChunks = 64;
+
+static inline uint64_t irnn_rotl(const uint64_t x, const int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// One 64-bit word into the hash h, as in MurmurHash3.
+static inline uint64_t irnn_hash_word(uint64_t h, uint64_t k) {
+  k *= 0x87C37B91114253D5ULL;
+  k = irnn_rotl(k, 31);
+  k *= 0x4CF5AD432745937FULL;
+  h ^= k;
+  return irnn_rotl(h, 27) * 5 + 0x52DCE729;
+}
+
+static uint64_t irnn_hash_bytes(const unsigned char* data,
+    const size_t bytes) {
+  uint64_t h = bytes;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+    uint64_t k;
+    memcpy(&k, data + i, sizeof(k));
+    h = irnn_hash_word(h, k);
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + i, bytes - i);
+  return irnn_hash_word(h, tail);
+}
+
+static uint64_t irnn_fingerprint(const void* data, const size_t bytes) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  const int chunks = static_cast<int>(
+      (bytes + kIRNNHashChunkBytes - 1) / kIRNNHashChunkBytes);
+  // the chunks are hashed in rounds whose hashes fit on the stack, so that
+  // a pass does not allocate whatever the size of the bottom
+  uint64_t hashes[kIRNNHashRoundChunks];
+  uint64_t h = bytes;
+  for (int first = 0; first < chunks; first += kIRNNHashRoundChunks) {
+    const int round = std::min(kIRNNHashRoundChunks, chunks - first);
+#ifdef _OPENMP
+#pragma omp parallel for if (round > 1)
+#endif
+    for (int c = 0; c < round; ++c) {
+      const size_t begin = (first + c) * kIRNNHashChunkBytes;
+      hashes[c] = irnn_hash_bytes(p + begin,
+          std::min(kIRNNHashChunkBytes, bytes - begin));
+    }
+    for (int c = 0; c < round; ++c) {
+      h = irnn_hash_word(h, hashes[c]);
+    }
+  }
+  return h;
+}
+
+template <typename Dtype>
+static uint64_t irnn_fingerprint(const Blob<Dtype>& blob) {
+  return irnn_fingerprint(blob.cpu_data(), blob.count() * sizeof(Dtype));
+}
+
+template <typename Dtype>
+void IRNNOutputCache<Dtype>::Fingerprint(const Blob<Dtype>& bottom,
+    const vector<shared_ptr<Blob<Dtype> > >& weights) {
+  next_weights_hash_ = weights.size();
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    // hashed where they live, so that the pass does not copy them to the
+    // host, with a single read back of both sums
+    if (!gpu_hashes_) {
+      gpu_hashes_.reset(new SyncedMemory(2 * sizeof(uint64_t)));
+    }
+    uint64_t* sums = static_cast<uint64_t*>(gpu_hashes_->mutable_gpu_data());
+    caffe_gpu_memset(2 * sizeof(uint64_t), 0, sums);
+    for (int i = 0; i < weights.size(); ++i) {
+      irnn_fingerprint_gpu(weights[i]->gpu_data(),
+          weights[i]->count() * sizeof(Dtype), i, sums);
+    }
+    if (next_bottom_known_) {
+      irnn_fingerprint_gpu(bottom.gpu_data(), bottom.count() * sizeof(Dtype),
+          0, sums + 1);
+    }
+    const uint64_t* hashes =
+        static_cast<const uint64_t*>(gpu_hashes_->cpu_data());
+    next_weights_hash_ = irnn_hash_word(next_weights_hash_, hashes[0]);
+    next_bottom_hash_ = hashes[1];
+    return;
+  }
+#endif
+  for (int i = 0; i < weights.size(); ++i) {
+    next_weights_hash_ = irnn_hash_word(next_weights_hash_,
+        irnn_fingerprint(*weights[i]));
+  }
+  if (next_bottom_known_) {
+    next_bottom_hash_ = irnn_fingerprint(bottom);
+  }
+}
+
+template <typename Dtype>
+bool IRNNOutputCache<Dtype>::Restore(const Blob<Dtype>& bottom,
+    const vector<shared_ptr<Blob<Dtype> > >& weights, Blob<Dtype>* top) {
+  if (!fingerprint_ && !frozen_) {
+    return false;
+  }
+  next_bottom_shape_ = bottom.shape();
+  next_bottom_known_ = !frozen_;
+  Fingerprint(bottom, weights);
+  if (!valid_ || next_bottom_shape_ != bottom_shape_ ||
+      next_weights_hash_ != weights_hash_) {
+    return false;
+  }
+  if (!frozen_ && (!bottom_known_ || next_bottom_hash_ != bottom_hash_)) {
+    return false;
+  }
+  top->CopyFrom(top_);
+  return true;
+}
+
+template <typename Dtype>
+void IRNNOutputCache<Dtype>::Store(const Blob<Dtype>& top) {
+  if (!fingerprint_ && !frozen_) {
+    return;
+  }
+  top_.CopyFrom(top, false, true);
+  bottom_shape_ = next_bottom_shape_;
+  bottom_known_ = next_bottom_known_;
+  bottom_hash_ = next_bottom_hash_;
+  weights_hash_ = next_weights_hash_;
+  valid_ = true;
+}
+
+INSTANTIATE_CLASS(IRNNOutputCache);
+
+// Elements spanned by the matrices of a sweep.
+static int irnn_sweep_span(const IRNNSweep& sweep) {
+  return (sweep.groups - 1) * sweep.group_stride +
+      (sweep.steps - 1) * sweep.step_stride +
+      (sweep.channels - 1) * sweep.ld + sweep.length;
+}
+
+static bool irnn_same_layout(const IRNNSweep& a, const IRNNSweep& b) {
+  return a.steps == b.steps && a.groups == b.groups &&
+      a.channels == b.channels && a.length == b.length && a.ld == b.ld &&
+      a.step_stride == b.step_stride && a.group_stride == b.group_stride &&
+      a.reverse == b.reverse;
+}
+
+// Offset of the step visited s-th.
+static inline int irnn_step_offset(const IRNNSweep& sweep, const int s) {
+  return (sweep.reverse ? sweep.steps - 1 - s : s) * sweep.step_stride;
+}
+
+// Copies the steps visited from begin-th to end-th, excluded.
+template <typename Dtype>
+static void irnn_copy_steps(const IRNNSweep& sweep, const int begin,
+    const int end, const Dtype* src, Dtype* dst) {
+  for (int s = begin; s < end; ++s) {
+    for (int g = 0; g < sweep.groups; ++g) {
+      for (int c = 0; c < sweep.channels; ++c) {
+        const int offset = g * sweep.group_stride +
+            irnn_step_offset(sweep, s) + c * sweep.ld;
+        memcpy(dst + offset, src + offset, sweep.length * sizeof(Dtype));
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+static int irnn_first_changed_step(const IRNNSweep& sweep, const Dtype* x,
+    const Dtype* x_last) {
+  for (int s = 0; s < sweep.steps; ++s) {
+    for (int g = 0; g < sweep.groups; ++g) {
+      for (int c = 0; c < sweep.channels; ++c) {
+        const int offset = g * sweep.group_stride +
+            irnn_step_offset(sweep, s) + c * sweep.ld;
+        if (memcmp(x + offset, x_last + offset,
+            sweep.length * sizeof(Dtype))) {
+          return s;
+        }
+      }
+    }
+  }
+  return sweep.steps;
+}
+
+template <typename Dtype>
+void IRNNIncremental<Dtype>::set_changed_positions(const int begin,
+    const int end) {
+  CHECK_LE(0, begin);
+  CHECK_LE(begin, end);
+  hint_begin_ = begin;
+  hint_end_ = end;
+}
+
+template <typename Dtype>
+int IRNNIncremental<Dtype>::Resume(const IRNNSweep& sweep,
+    const vector<shared_ptr<Blob<Dtype> > >& weights, Dtype* h) {
+  uint64_t weights_hash = weights.size();
+  for (int i = 0; i < weights.size(); ++i) {
+    weights_hash = irnn_hash_word(weights_hash, irnn_fingerprint(*weights[i]));
+  }
+  int first = 0;
+  if (valid_ && irnn_same_layout(sweep, sweep_) &&
+      weights_hash == weights_hash_) {
+    if (hint_begin_ < 0) {
+      first = irnn_first_changed_step(sweep, h, x_.cpu_data());
+    } else {
+      // the first changed position the sweep reaches
+      first = sweep.reverse ? sweep.steps - std::min(hint_end_, sweep.steps) :
+          std::min(hint_begin_, sweep.steps);
+      if (hint_begin_ == hint_end_) {
+        first = sweep.steps;
+      }
+    }
+  } else {
+    x_.Reshape(vector<int>(1, irnn_sweep_span(sweep)));
+    h_.Reshape(vector<int>(1, irnn_sweep_span(sweep)));
+  }
+  hint_begin_ = hint_end_ = -1;
+  valid_ = false;
+  sweep_ = sweep;
+  weights_hash_ = weights_hash;
+  irnn_copy_steps(sweep, first, sweep.steps, h, x_.mutable_cpu_data());
+  irnn_copy_steps(sweep, 0, first, h_.cpu_data(), h);
+  return first;
+}
+
+template <typename Dtype>
+void IRNNIncremental<Dtype>::Store(const IRNNSweep& sweep, const int first,
+    const Dtype* h) {
+  irnn_copy_steps(sweep, first, sweep.steps, h, h_.mutable_cpu_data());
+  valid_ = true;
+}
+
+INSTANTIATE_CLASS(IRNNIncremental);
+
+}  // namespace caffe
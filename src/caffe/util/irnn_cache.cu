@@ -0,0 +1,78 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "caffe/common.hpp"
+#include "caffe/util/irnn_cache.hpp"
+
+namespace caffe {
+
+// The finalizer of MurmurHash3.
+__device__ inline uint64_t irnn_mix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xFF51AFD7ED558CCDULL;
+  k ^= k >> 33;
+  k *= 0xC4CEB9FE1A85EC53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// word i of a buffer hashed with seed, as a term of the sum
+__device__ inline uint64_t irnn_term(const uint64_t word, const int seed,
+    const int i) {
+  return irnn_mix(word ^ irnn_mix((static_cast<uint64_t>(seed) << 32) +
+      static_cast<uint64_t>(i) + 1));
+}
+
+// *sum += the terms of the words words of data and of its last tail bytes.
+// The threads of a block add theirs in shared memory, and the blocks their
+// totals atomically.
+__global__ void IRNNFingerprint(const int words, const int tail,
+    const unsigned char* data, const int seed,
+    unsigned long long* sum) {  // NOLINT(runtime/int)
+  __shared__ unsigned long long buffer[CAFFE_CUDA_NUM_THREADS];  // NOLINT
+  const uint64_t* data_words = reinterpret_cast<const uint64_t*>(data);
+  uint64_t h = 0;
+  CUDA_KERNEL_LOOP(index, words) {
+    h += irnn_term(data_words[index], seed, index);
+  }
+  if (tail > 0 && blockIdx.x == 0 && threadIdx.x == 0) {
+    uint64_t word = 0;
+    for (int b = 0; b < tail; ++b) {
+      word |= static_cast<uint64_t>(data[8 * words + b]) << (8 * b);
+    }
+    h += irnn_term(word, seed, words);
+  }
+  buffer[threadIdx.x] = h;
+  __syncthreads();
+  for (int stride = blockDim.x / 2; stride > 0; stride /= 2) {
+    if (threadIdx.x < stride) {
+      buffer[threadIdx.x] += buffer[threadIdx.x + stride];
+    }
+    __syncthreads();
+  }
+  if (threadIdx.x == 0) {
+    atomicAdd(sum, buffer[0]);
+  }
+}
+
+void irnn_fingerprint_gpu(const void* data, const size_t bytes,
+    const int seed, uint64_t* sum) {
+  const int words = static_cast<int>(bytes / sizeof(uint64_t));
+  const int tail = static_cast<int>(bytes % sizeof(uint64_t));
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  IRNNFingerprint<<<std::max(1, CAFFE_GET_BLOCKS(words)),
+      CAFFE_CUDA_NUM_THREADS>>>(words, tail,
+      static_cast<const unsigned char*>(data), seed,
+      reinterpret_cast<unsigned long long*>(sum));  // NOLINT(runtime/int)
+  CUDA_POST_KERNEL_CHECK;
+}
+
+}  // namespace caffe
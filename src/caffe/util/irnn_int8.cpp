@@ -0,0 +1,350 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IRNN_INT8_X86
+#include <immintrin.h>
+// AVX-VNNI, the VEX form of the instruction, came with GCC 11 and clang 12.
+#if (defined(__clang__) && __clang_major__ >= 12) || \
+    (!defined(__clang__) && __GNUC__ >= 11)
+#define IRNN_INT8_AVXVNNI
+#endif
+#endif
+
+#include "caffe/common.hpp"
+#include "caffe/util/irnn_int8.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Scan lines handled by one call of irnn_dot_u8s8.
+static const int kIRNNDotLines = 8;
+
+// acc[j] = sum over k of w[k] * h[k][j], for the n <= kIRNNDotLines scan
+// lines of h. w holds 4 int8 weights per word and w16 the same weights as
+// int16, 2 per word. The packed hidden states of the k-th word are found
+// at h + k * stride.
+typedef void (*IRNNDotU8S8)(const int words, const int* w, const int* w16,
+    const uint8_t* h, const int stride, const int n, int* acc);
+
+static void irnn_dot_u8s8_scalar(const int words, const int* w,
+    const int*, const uint8_t* h, const int stride, const int n,
+    int* acc) {
+  const int8_t* wb = reinterpret_cast<const int8_t*>(w);
+  for (int j = 0; j < n; ++j) {
+    acc[j] = 0;
+  }
+  for (int k = 0; k < words; ++k) {
+    const uint8_t* h_k = h + k * stride;
+    const int8_t* w_k = wb + 4 * k;
+    for (int j = 0; j < n; ++j) {
+      const uint8_t* h_j = h_k + 4 * j;
+      acc[j] += h_j[0] * w_k[0] + h_j[1] * w_k[1] + h_j[2] * w_k[2] +
+          h_j[3] * w_k[3];
+    }
+  }
+}
+
+#ifdef IRNN_INT8_X86
+
+// Compiled for their instruction set through the target attribute and
+// picked at run time, as the kernels of irnn_simd.cpp. They take the full
+// groups of kIRNNDotLines lines and leave the last, narrower one to the
+// scalar loop.
+
+__attribute__((target("avx512vnni,avx512vl")))
+static void irnn_dot_u8s8_avx512vnni(const int words, const int* w,
+    const int*, const uint8_t* h, const int stride, const int n,
+    int* acc) {
+  if (n < kIRNNDotLines) {
+    irnn_dot_u8s8_scalar(words, w, NULL, h, stride, n, acc);
+    return;
+  }
+  __m256i sum = _mm256_setzero_si256();
+  for (int k = 0; k < words; ++k) {
+    sum = _mm256_dpbusd_epi32(sum,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + k * stride)),
+        _mm256_set1_epi32(w[k]));
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), sum);
+}
+
+#ifdef IRNN_INT8_AVXVNNI
+__attribute__((target("avxvnni,avx2")))
+static void irnn_dot_u8s8_avxvnni(const int words, const int* w,
+    const int*, const uint8_t* h, const int stride, const int n,
+    int* acc) {
+  if (n < kIRNNDotLines) {
+    irnn_dot_u8s8_scalar(words, w, NULL, h, stride, n, acc);
+    return;
+  }
+  __m256i sum = _mm256_setzero_si256();
+  for (int k = 0; k < words; ++k) {
+    sum = _mm256_dpbusd_avx_epi32(sum,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + k * stride)),
+        _mm256_set1_epi32(w[k]));
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), sum);
+}
+#endif  // IRNN_INT8_AVXVNNI
+
+__attribute__((target("avx2")))
+static void irnn_dot_u8s8_avx2(const int words, const int* w,
+    const int* w16, const uint8_t* h, const int stride, const int n,
+    int* acc) {
+  if (n < kIRNNDotLines) {
+    irnn_dot_u8s8_scalar(words, w, w16, h, stride, n, acc);
+    return;
+  }
+  // Widened to int16, the 4 channels of a scan line meet 4 weights in two
+  // pairs of _mm256_madd_epi16, which cannot saturate, unlike maddubs.
+  // lo holds the pairs of lines 0-3, hi those of lines 4-7.
+  __m256i lo = _mm256_setzero_si256();
+  __m256i hi = _mm256_setzero_si256();
+  for (int k = 0; k < words; ++k) {
+    int64_t w4;
+    memcpy(&w4, w16 + 2 * k, sizeof(w4));
+    const __m256i wv = _mm256_set1_epi64x(w4);
+    const __m256i hv =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + k * stride));
+    lo = _mm256_add_epi32(lo, _mm256_madd_epi16(
+        _mm256_cvtepu8_epi16(_mm256_castsi256_si128(hv)), wv));
+    hi = _mm256_add_epi32(hi, _mm256_madd_epi16(
+        _mm256_cvtepu8_epi16(_mm256_extracti128_si256(hv, 1)), wv));
+  }
+  // the pairwise sums come out as lines 0 1 4 5 | 2 3 6 7
+  const __m256i sum = _mm256_permute4x64_epi64(_mm256_hadd_epi32(lo, hi),
+      0xD8);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), sum);
+}
+
+#endif  // IRNN_INT8_X86
+
+// The dot product of isa if this build has it and the host runs it, NULL
+// otherwise.
+static IRNNDotU8S8 irnn_find_dot_u8s8(const string& isa) {
+#ifdef IRNN_INT8_X86
+  __builtin_cpu_init();
+  if (isa == "avx512vnni") {
+    return __builtin_cpu_supports("avx512vnni") &&
+        __builtin_cpu_supports("avx512vl") ? irnn_dot_u8s8_avx512vnni : NULL;
+  }
+#ifdef IRNN_INT8_AVXVNNI
+  if (isa == "avxvnni") {
+    return __builtin_cpu_supports("avxvnni") ? irnn_dot_u8s8_avxvnni : NULL;
+  }
+#endif
+  if (isa == "avx2") {
+    return __builtin_cpu_supports("avx2") ? irnn_dot_u8s8_avx2 : NULL;
+  }
+#endif
+  return isa == "scalar" ? irnn_dot_u8s8_scalar : NULL;
+}
+
+// The instruction sets of the dot products, in order of preference.
+static const char* const kIRNNDotISAs[] = {"avx512vnni", "avxvnni", "avx2",
+    "scalar"};
+static const int kIRNNDotNumISAs = 4;
+
+struct IRNNDotKernel {
+  const char* isa;
+  IRNNDotU8S8 dot;
+};
+
+static IRNNDotKernel irnn_select_dot_u8s8() {
+  IRNNDotKernel kernel = {"scalar", irnn_dot_u8s8_scalar};
+  for (int i = 0; i < kIRNNDotNumISAs; ++i) {
+    const IRNNDotU8S8 dot = irnn_find_dot_u8s8(kIRNNDotISAs[i]);
+    if (dot) {
+      kernel.isa = kIRNNDotISAs[i];
+      kernel.dot = dot;
+      break;
+    }
+  }
+  return kernel;
+}
+
+// Selected once, on the first int8 pass, unless irnn_int8_set_isa picks
+// another one.
+static IRNNDotKernel& irnn_dot_kernel() {
+  static IRNNDotKernel kernel = irnn_select_dot_u8s8();
+  return kernel;
+}
+
+static IRNNDotU8S8 irnn_dot_u8s8() {
+  return irnn_dot_kernel().dot;
+}
+
+const char* irnn_int8_isa() {
+  return irnn_dot_kernel().isa;
+}
+
+bool irnn_int8_set_isa(const string& isa) {
+  for (int i = 0; i < kIRNNDotNumISAs; ++i) {
+    const IRNNDotU8S8 dot = irnn_find_dot_u8s8(kIRNNDotISAs[i]);
+    if (isa == kIRNNDotISAs[i] && dot) {
+      irnn_dot_kernel().isa = kIRNNDotISAs[i];
+      irnn_dot_kernel().dot = dot;
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Dtype>
+void IRNNInt8<Dtype>::SetUp(const int channels, const int calibration_iter) {
+  CHECK_GT(calibration_iter, 0)
+      << "The int8 scales need at least one calibration pass";
+  channels_ = channels;
+  words_ = (channels + 3) / 4;
+  calibration_iter_ = calibration_iter;
+  seen_ = 0;
+  vector<int> shape(1, channels_);
+  h_max_.Reshape(shape);
+  h_scale_.Reshape(shape);
+  w_scale_.Reshape(shape);
+  caffe_set(channels_, Dtype(0.), h_max_.mutable_cpu_data());
+  shape.push_back(words_);
+  w_q_.Reshape(shape);
+  shape[1] = 2 * words_;
+  w_q16_.Reshape(shape);
+}
+
+template <typename Dtype>
+void IRNNInt8<Dtype>::Reshape(const IRNNSweep& sweep) {
+  CHECK_EQ(channels_, sweep.channels);
+  vector<int> shape(3);
+  shape[0] = 2;
+  shape[1] = words_;
+  shape[2] = sweep.length;
+  h_q_.Reshape(shape);
+}
+
+template <typename Dtype>
+void IRNNInt8<Dtype>::Calibrate(const IRNNSweep& sweep, const Dtype* h) {
+  Dtype* h_max = h_max_.mutable_cpu_data();
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int i = 0; i < sweep.steps; ++i) {
+      const Dtype* h_i = h + g * sweep.group_stride + i * sweep.step_stride;
+      for (int c = 0; c < channels_; ++c) {
+        const Dtype* row = h_i + c * sweep.ld;
+        h_max[c] = std::max(h_max[c], *std::max_element(row,
+            row + sweep.length));
+      }
+    }
+  }
+  ++seen_;
+}
+
+template <typename Dtype>
+void IRNNInt8<Dtype>::QuantizeWeights(const Dtype* w) {
+  const Dtype* h_max = h_max_.cpu_data();
+  Dtype* h_scale = h_scale_.mutable_cpu_data();
+  Dtype* w_scale = w_scale_.mutable_cpu_data();
+  for (int c = 0; c < channels_; ++c) {
+    // a channel that never fired keeps an arbitrary scale, it stays 0
+    h_scale[c] = h_max[c] > 0 ? h_max[c] / Dtype(255.) : Dtype(1.);
+  }
+  int8_t* w_q = reinterpret_cast<int8_t*>(w_q_.mutable_cpu_data());
+  int16_t* w_q16 = reinterpret_cast<int16_t*>(w_q16_.mutable_cpu_data());
+  const int padded = 4 * words_;
+  for (int c = 0; c < channels_; ++c) {
+    const Dtype* w_c = w + c * channels_;
+    Dtype w_max = 0;
+    for (int k = 0; k < channels_; ++k) {
+      w_max = std::max(w_max, std::fabs(w_c[k] * h_scale[k]));
+    }
+    w_scale[c] = w_max > 0 ? w_max / Dtype(127.) : Dtype(1.);
+    for (int k = 0; k < padded; ++k) {
+      int8_t q = 0;
+      if (k < channels_) {
+        q = static_cast<int8_t>(std::floor(w_c[k] * h_scale[k] / w_scale[c] +
+            Dtype(0.5)));
+      }
+      w_q[c * padded + k] = q;
+      w_q16[c * padded + k] = q;
+    }
+  }
+  // taken here, outside of the threads sweeping the slabs, which must not
+  // touch the SyncedMemory of the blobs
+  h_q_data_ = reinterpret_cast<uint8_t*>(h_q_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void IRNNInt8<Dtype>::Forward(const IRNNSweep& sweep, Dtype* h,
+    const int slab, const int slabs) {
+  const int L = sweep.length;
+  const int begin = slab * L / slabs;
+  const int end = (slab + 1) * L / slabs;
+  const Dtype* h_scale = h_scale_.cpu_data();
+  const Dtype* w_scale = w_scale_.cpu_data();
+  const int* w_q = w_q_.cpu_data();
+  const int* w_q16 = w_q16_.cpu_data();
+  // the slabs use disjoint columns of the quantized hidden states
+  uint8_t* h_q[2];
+  h_q[0] = h_q_data_;
+  h_q[1] = h_q[0] + 4 * words_ * L;
+  const IRNNDotU8S8 dot = irnn_dot_u8s8();
+  int acc[kIRNNDotLines];
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int t = begin; t < end; t += sweep.tile) {
+      const int cols = std::min(sweep.tile, end - t);
+      for (int s = 0; s < sweep.steps; ++s) {
+        const int i = sweep.reverse ? sweep.steps - 1 - s : s;
+        Dtype* x = h + g * sweep.group_stride + i * sweep.step_stride + t;
+        const uint8_t* prev = h_q[(s + 1) % 2] + 4 * t;
+        uint8_t* cur = h_q[s % 2] + 4 * t;
+        for (int c = 0; c < channels_; ++c) {
+          Dtype* row = x + c * sweep.ld;
+          uint8_t* q_c = cur + (c / 4) * 4 * L + c % 4;
+          const Dtype inv_scale = Dtype(1.) / h_scale[c];
+          for (int l = 0; l < cols; l += kIRNNDotLines) {
+            const int n = std::min(kIRNNDotLines, cols - l);
+            if (s > 0) {
+              dot(words_, w_q + c * words_, w_q16 + 2 * c * words_,
+                  prev + 4 * l, 4 * L, n, acc);
+            }
+            for (int j = 0; j < n; ++j) {
+              Dtype z = row[l + j];
+              if (s > 0) {
+                z += w_scale[c] * acc[j];
+              }
+              // ReLU and requantization
+              z = std::max(z, Dtype(0.));
+              row[l + j] = z;
+              q_c[4 * (l + j)] = static_cast<uint8_t>(
+                  std::min(z * inv_scale + Dtype(0.5), Dtype(255.)));
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void IRNNInt8<Dtype>::Forward(const IRNNSweep& sweep, Dtype* h) {
+  const int slabs = irnn_cpu_slabs(sweep, irnn_cpu_workers());
+#ifdef _OPENMP
+#pragma omp parallel for if (slabs > 1)
+#endif
+  for (int slab = 0; slab < slabs; ++slab) {
+    Forward(sweep, h, slab, slabs);
+  }
+}
+
+INSTANTIATE_CLASS(IRNNInt8);
+
+}  // namespace caffe
@@ -0,0 +1,1018 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <unistd.h>
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/irnn_profile.hpp"
+#include "caffe/util/irnn_simd.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+IRNNSweep irnn_nchw_sweep(const int num, const int channels,
+    const int height, const int width, const int group_stride,
+    const bool reverse) {
+  IRNNSweep sweep;
+  sweep.steps = height;
+  sweep.groups = num;
+  sweep.channels = channels;
+  sweep.length = width;
+  sweep.ld = height * width;
+  sweep.step_stride = width;
+  sweep.group_stride = group_stride;
+  sweep.reverse = reverse;
+  sweep.tile = width;
+  return sweep;
+}
+
+IRNNSweep irnn_step_major_sweep(const int steps, const int channels,
+    const int length, const bool reverse) {
+  IRNNSweep sweep;
+  sweep.steps = steps;
+  sweep.groups = 1;
+  sweep.channels = channels;
+  sweep.length = length;
+  sweep.ld = length;
+  sweep.step_stride = channels * length;
+  sweep.group_stride = 0;
+  sweep.reverse = reverse;
+  sweep.tile = length;
+  return sweep;
+}
+
+IRNNSweep irnn_tail_sweep(const IRNNSweep& sweep, const int first,
+    int* offset) {
+  IRNNSweep tail = sweep;
+  *offset = 0;
+  if (first > 0) {
+    tail.steps = sweep.steps - first + 1;
+    // a reverse sweep still ends on the step at offset 0
+    if (!sweep.reverse) {
+      *offset = (first - 1) * sweep.step_stride;
+    }
+  }
+  return tail;
+}
+
+IRNNSweep irnn_group_sweep(const IRNNSweep& sweep, const int group,
+    const int steps, const int length, int* offset) {
+  IRNNSweep part = sweep;
+  part.steps = steps;
+  part.groups = 1;
+  part.length = length;
+  part.tile = std::min(sweep.tile, length);
+  *offset = group * sweep.group_stride;
+  return part;
+}
+
+// Narrowest slab worth a worker of its own. Below this the per-step GEMMs
+// are too thin to keep a core busy.
+static const int kIRNNMinSlabLines = 16;
+
+// L2 size assumed when the system does not report it.
+static const long kIRNNDefaultL2Bytes = 256 * 1024;
+
+static long irnn_query_l2_bytes() {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  const long bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  if (bytes > 0) {
+    return bytes;
+  }
+#endif
+  return kIRNNDefaultL2Bytes;
+}
+
+// Queried once, as the layers pick their tiles in every Reshape, which runs
+// before each forward pass.
+static long irnn_l2_bytes() {
+  static const long bytes = irnn_query_l2_bytes();
+  return bytes;
+}
+
+template <typename Dtype>
+int irnn_cpu_tile(const IRNNSweep& sweep) {
+  const long NH = sweep.channels;
+  // the other half is left to the column blocks of irnn_step_cpu and to
+  // whatever else is streamed through
+  const long budget = irnn_l2_bytes() / 2 / sizeof(Dtype) - NH * NH;
+  if (budget < 2 * NH * kIRNNMinSlabLines) {
+    // W leaves no room for the hidden states of even a narrow tile, so it is
+    // streamed from beyond L2 anyway. Every tile would stream it once more
+    // per step; sweeping all the lines at once reads it once per step.
+    return sweep.length;
+  }
+  const long tile = budget / (2 * NH) / 8 * 8;
+  return static_cast<int>(std::min<long>(sweep.length, tile));
+}
+
+template int irnn_cpu_tile<float>(const IRNNSweep& sweep);
+template int irnn_cpu_tile<double>(const IRNNSweep& sweep);
+
+// caffe_cpu_gemm with explicit leading dimensions, so that the matrices of
+// a step can be taken in place from a blob.
+template <typename Dtype>
+void irnn_cpu_gemm(const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const Dtype alpha, const Dtype* A,
+    const int lda, const Dtype* B, const int ldb, const Dtype beta, Dtype* C,
+    const int ldc);
+
+template <>
+void irnn_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+      beta, C, ldc);
+}
+
+template <>
+void irnn_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+      beta, C, ldc);
+}
+
+// Bytes of the output tile of one GEMM call in irnn_step_cpu. The tile and
+// the previous hidden states it reads stay in L2 until the ReLU has clamped
+// it, instead of making a second pass over the whole slab from memory.
+static const int kIRNNStepTileBytes = 128 * 1024;
+
+template <typename Dtype>
+void irnn_step_cpu(const int channels, const int length, const int ld,
+    const Dtype* w, const Dtype* h_prev, Dtype* h) {
+  int block = kIRNNStepTileBytes / (channels * sizeof(Dtype));
+  block = std::min(length, std::max(8, block / 8 * 8));
+  for (int l = 0; l < length; l += block) {
+    const int cols = std::min(block, length - l);
+    if (h_prev) {
+      irnn_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, cols,
+          channels, Dtype(1.), w, channels, h_prev + l, ld, Dtype(1.), h + l,
+          ld);
+    }
+    for (int c = 0; c < channels; ++c) {
+      irnn_relu_cpu(cols, h + c * ld + l);
+    }
+  }
+}
+
+template void irnn_step_cpu<float>(const int channels, const int length,
+    const int ld, const float* w, const float* h_prev, float* h);
+template void irnn_step_cpu<double>(const int channels, const int length,
+    const int ld, const double* w, const double* h_prev, double* h);
+
+int irnn_cpu_workers() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+int irnn_cpu_slabs(const IRNNSweep& sweep, const int workers) {
+  return std::max(1, std::min(workers, sweep.length / kIRNNMinSlabLines));
+}
+
+template <typename Dtype>
+void irnn_forward_cpu(const IRNNSweep& sweep, const Dtype* w, Dtype* h,
+    const int slab, const int slabs) {
+  const int begin = slab * sweep.length / slabs;
+  const int end = (slab + 1) * sweep.length / slabs;
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int t = begin; t < end; t += sweep.tile) {
+      const int cols = std::min(sweep.tile, end - t);
+      Dtype* h_t = h + g * sweep.group_stride + t;
+      for (int s = 0; s < sweep.steps; ++s) {
+        const int i = sweep.reverse ? sweep.steps - 1 - s : s;
+        const int prev = sweep.reverse ? i + 1 : i - 1;
+        IRNN_PROFILE_TIME(STEP);
+        irnn_step_cpu(sweep.channels, cols, sweep.ld, w,
+            s > 0 ? h_t + prev * sweep.step_stride : NULL,
+            h_t + i * sweep.step_stride);
+      }
+    }
+  }
+}
+
+template void irnn_forward_cpu<float>(const IRNNSweep& sweep,
+    const float* w, float* h, const int slab, const int slabs);
+template void irnn_forward_cpu<double>(const IRNNSweep& sweep,
+    const double* w, double* h, const int slab, const int slabs);
+
+template <typename Dtype>
+void irnn_forward_cpu(const IRNNSweep& sweep, const Dtype* w, Dtype* h) {
+  const int slabs = irnn_cpu_slabs(sweep, irnn_cpu_workers());
+  IRNN_PROFILE_CAPTURE();
+#ifdef _OPENMP
+#pragma omp parallel for if (slabs > 1)
+#endif
+  for (int slab = 0; slab < slabs; ++slab) {
+    IRNN_PROFILE_ATTACH();
+    irnn_forward_cpu(sweep, w, h, slab, slabs);
+  }
+}
+
+template void irnn_forward_cpu<float>(const IRNNSweep& sweep,
+    const float* w, float* h);
+template void irnn_forward_cpu<double>(const IRNNSweep& sweep,
+    const double* w, double* h);
+
+template <typename Dtype>
+void irnn_backward_chain_cpu(const IRNNSweep& sweep, const Dtype* w,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    const int slab, const int slabs) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  const int begin = slab * L / slabs;
+  const int end = (slab + 1) * L / slabs;
+  // the groups and the tiles are independent, so each one runs its whole
+  // chain in turn
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int t = begin; t < end; t += sweep.tile) {
+      const int cols = std::min(sweep.tile, end - t);
+      Dtype* carry_t = carry + t;
+      for (int c = 0; c < NH; ++c) {
+        caffe_set(cols, Dtype(0.), carry_t + c * L);
+      }
+      for (int s = 0; s < sweep.steps; ++s) {
+        // the backward pass visits the steps in the opposite order
+        const int i = sweep.reverse ? s : sweep.steps - 1 - s;
+        const int offset = g * sweep.group_stride + i * sweep.step_stride + t;
+        // dzdf
+        {
+          IRNN_PROFILE_TIME(RELU_GRAD);
+          for (int c = 0; c < NH; ++c) {
+            const int row = offset + c * sweep.ld;
+            irnn_relu_grad_cpu(cols, top_diff + row, carry_t + c * L,
+                h + row, bottom_diff + row);
+          }
+        }
+        if (s == sweep.steps - 1) {
+          continue;
+        }
+        IRNN_PROFILE_TIME(CHAIN_GEMM);
+        // dzdhh
+        irnn_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, NH, cols, NH,
+            Dtype(1.), w, NH, bottom_diff + offset, sweep.ld, Dtype(0.),
+            carry_t, L);
+      }
+    }
+  }
+}
+
+template void irnn_backward_chain_cpu<float>(const IRNNSweep& sweep,
+    const float* w, const float* h, const float* top_diff,
+    float* bottom_diff, float* carry, const int slab, const int slabs);
+template void irnn_backward_chain_cpu<double>(const IRNNSweep& sweep,
+    const double* w, const double* h, const double* top_diff,
+    double* bottom_diff, double* carry, const int slab, const int slabs);
+
+template <typename Dtype>
+void irnn_weight_diff_cpu(const IRNNSweep& sweep, const Dtype* h,
+    const Dtype* dz, Dtype* w_diff) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  if (sweep.steps < 2) {
+    return;
+  }
+  IRNN_PROFILE_TIME(WEIGHT_DIFF);
+  // dzdw, the sum over the steps of dz * h_prev^T. first is the lowest step
+  // that has a previous one, which sits at first + shift.
+  const int first = sweep.reverse ? 0 : 1;
+  const int shift = sweep.reverse ? 1 : -1;
+  if (sweep.step_stride == L && sweep.ld >= sweep.steps * L) {
+    // the steps lie side by side in the rows of a group, so all of them
+    // make up one GEMM over (steps - 1) * length columns
+    for (int g = 0; g < sweep.groups; ++g) {
+      const int offset = g * sweep.group_stride + first * L;
+      irnn_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, NH, NH,
+          (sweep.steps - 1) * L, Dtype(1.), dz + offset, sweep.ld,
+          h + offset + shift * L, sweep.ld, Dtype(1.), w_diff, NH);
+    }
+  } else {
+    // step-major, or a ragged sample with padding between its steps
+    for (int g = 0; g < sweep.groups; ++g) {
+      for (int i = first; i < first + sweep.steps - 1; ++i) {
+        const int offset = g * sweep.group_stride + i * sweep.step_stride;
+        irnn_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, NH, NH, L, Dtype(1.),
+            dz + offset, sweep.ld, h + offset + shift * sweep.step_stride,
+            sweep.ld, Dtype(1.), w_diff, NH);
+      }
+    }
+  }
+}
+
+template void irnn_weight_diff_cpu<float>(const IRNNSweep& sweep,
+    const float* h, const float* dz, float* w_diff);
+template void irnn_weight_diff_cpu<double>(const IRNNSweep& sweep,
+    const double* h, const double* dz, double* w_diff);
+
+template <typename Dtype>
+void irnn_backward_cpu(const IRNNSweep& sweep, const Dtype* w,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    Dtype* w_diff) {
+  const int slabs = irnn_cpu_slabs(sweep, irnn_cpu_workers());
+  IRNN_PROFILE_CAPTURE();
+#ifdef _OPENMP
+#pragma omp parallel for if (slabs > 1)
+#endif
+  for (int slab = 0; slab < slabs; ++slab) {
+    IRNN_PROFILE_ATTACH();
+    irnn_backward_chain_cpu(sweep, w, h, top_diff, bottom_diff, carry, slab,
+        slabs);
+  }
+  // outside of the parallel region, so that BLAS may thread this GEMM
+  irnn_weight_diff_cpu(sweep, h, bottom_diff, w_diff);
+}
+
+template void irnn_backward_cpu<float>(const IRNNSweep& sweep,
+    const float* w, const float* h, const float* top_diff,
+    float* bottom_diff, float* carry, float* w_diff);
+template void irnn_backward_cpu<double>(const IRNNSweep& sweep,
+    const double* w, const double* h, const double* top_diff,
+    double* bottom_diff, double* carry, double* w_diff);
+
+template <typename Dtype>
+void irnn_step_cpu(const int channels, const int rank, const int length,
+    const int ld, const Dtype* u, const Dtype* v, const Dtype* h_prev,
+    Dtype* h, Dtype* tmp, const int ldt) {
+  int block = kIRNNStepTileBytes / (channels * sizeof(Dtype));
+  block = std::min(length, std::max(8, block / 8 * 8));
+  for (int l = 0; l < length; l += block) {
+    const int cols = std::min(block, length - l);
+    if (h_prev) {
+      // h += u * (v * h_prev), the identity is added with the ReLU
+      irnn_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, rank, cols, channels,
+          Dtype(1.), v, channels, h_prev + l, ld, Dtype(0.), tmp + l, ldt);
+      irnn_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, cols, rank,
+          Dtype(1.), u, rank, tmp + l, ldt, Dtype(1.), h + l, ld);
+    }
+    for (int c = 0; c < channels; ++c) {
+      Dtype* row = h + c * ld + l;
+      if (h_prev) {
+        irnn_axpy_relu_cpu(cols, Dtype(1.), h_prev + c * ld + l, row);
+      } else {
+        irnn_relu_cpu(cols, row);
+      }
+    }
+  }
+}
+
+template void irnn_step_cpu<float>(const int channels, const int rank,
+    const int length, const int ld, const float* u, const float* v,
+    const float* h_prev, float* h, float* tmp, const int ldt);
+template void irnn_step_cpu<double>(const int channels, const int rank,
+    const int length, const int ld, const double* u, const double* v,
+    const double* h_prev, double* h, double* tmp, const int ldt);
+
+template <typename Dtype>
+void irnn_forward_cpu(const IRNNSweep& sweep, const int rank, const Dtype* u,
+    const Dtype* v, Dtype* h, Dtype* tmp, const int slab, const int slabs) {
+  const int begin = slab * sweep.length / slabs;
+  const int end = (slab + 1) * sweep.length / slabs;
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int t = begin; t < end; t += sweep.tile) {
+      const int cols = std::min(sweep.tile, end - t);
+      Dtype* h_t = h + g * sweep.group_stride + t;
+      for (int s = 0; s < sweep.steps; ++s) {
+        const int i = sweep.reverse ? sweep.steps - 1 - s : s;
+        const int prev = sweep.reverse ? i + 1 : i - 1;
+        IRNN_PROFILE_TIME(STEP);
+        irnn_step_cpu(sweep.channels, rank, cols, sweep.ld, u, v,
+            s > 0 ? h_t + prev * sweep.step_stride : NULL,
+            h_t + i * sweep.step_stride, tmp + t, sweep.length);
+      }
+    }
+  }
+}
+
+template void irnn_forward_cpu<float>(const IRNNSweep& sweep,
+    const int rank, const float* u, const float* v, float* h, float* tmp,
+    const int slab, const int slabs);
+template void irnn_forward_cpu<double>(const IRNNSweep& sweep,
+    const int rank, const double* u, const double* v, double* h,
+    double* tmp, const int slab, const int slabs);
+
+template <typename Dtype>
+void irnn_forward_cpu(const IRNNSweep& sweep, const int rank, const Dtype* u,
+    const Dtype* v, Dtype* h, Dtype* tmp) {
+  const int slabs = irnn_cpu_slabs(sweep, irnn_cpu_workers());
+  IRNN_PROFILE_CAPTURE();
+#ifdef _OPENMP
+#pragma omp parallel for if (slabs > 1)
+#endif
+  for (int slab = 0; slab < slabs; ++slab) {
+    IRNN_PROFILE_ATTACH();
+    irnn_forward_cpu(sweep, rank, u, v, h, tmp, slab, slabs);
+  }
+}
+
+template void irnn_forward_cpu<float>(const IRNNSweep& sweep,
+    const int rank, const float* u, const float* v, float* h, float* tmp);
+template void irnn_forward_cpu<double>(const IRNNSweep& sweep,
+    const int rank, const double* u, const double* v, double* h,
+    double* tmp);
+
+template <typename Dtype>
+void irnn_backward_chain_cpu(const IRNNSweep& sweep, const int rank,
+    const Dtype* u, const Dtype* v, const Dtype* h, const Dtype* top_diff,
+    Dtype* bottom_diff, Dtype* carry, Dtype* tmp, const int slab,
+    const int slabs) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  const int begin = slab * L / slabs;
+  const int end = (slab + 1) * L / slabs;
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int t = begin; t < end; t += sweep.tile) {
+      const int cols = std::min(sweep.tile, end - t);
+      Dtype* carry_t = carry + t;
+      Dtype* tmp_t = tmp + t;
+      for (int c = 0; c < NH; ++c) {
+        caffe_set(cols, Dtype(0.), carry_t + c * L);
+      }
+      for (int s = 0; s < sweep.steps; ++s) {
+        const int i = sweep.reverse ? s : sweep.steps - 1 - s;
+        const int offset = g * sweep.group_stride + i * sweep.step_stride + t;
+        // dzdf
+        {
+          IRNN_PROFILE_TIME(RELU_GRAD);
+          for (int c = 0; c < NH; ++c) {
+            const int row = offset + c * sweep.ld;
+            irnn_relu_grad_cpu(cols, top_diff + row, carry_t + c * L,
+                h + row, bottom_diff + row);
+          }
+        }
+        if (s == sweep.steps - 1) {
+          continue;
+        }
+        IRNN_PROFILE_TIME(CHAIN_GEMM);
+        // dzdhh, w^T * dz = dz + v^T * (u^T * dz)
+        irnn_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, rank, cols, NH,
+            Dtype(1.), u, rank, bottom_diff + offset, sweep.ld, Dtype(0.),
+            tmp_t, L);
+        for (int c = 0; c < NH; ++c) {
+          caffe_copy(cols, bottom_diff + offset + c * sweep.ld,
+              carry_t + c * L);
+        }
+        irnn_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, NH, cols, rank,
+            Dtype(1.), v, NH, tmp_t, L, Dtype(1.), carry_t, L);
+      }
+    }
+  }
+}
+
+template void irnn_backward_chain_cpu<float>(const IRNNSweep& sweep,
+    const int rank, const float* u, const float* v, const float* h,
+    const float* top_diff, float* bottom_diff, float* carry, float* tmp,
+    const int slab, const int slabs);
+template void irnn_backward_chain_cpu<double>(const IRNNSweep& sweep,
+    const int rank, const double* u, const double* v, const double* h,
+    const double* top_diff, double* bottom_diff, double* carry, double* tmp,
+    const int slab, const int slabs);
+
+template <typename Dtype>
+void irnn_weight_diff_cpu(const IRNNSweep& sweep, const int rank,
+    const Dtype* u, const Dtype* v, const Dtype* h, const Dtype* dz,
+    Dtype* tmp, Dtype* u_diff, Dtype* v_diff) {
+  IRNN_PROFILE_TIME(WEIGHT_DIFF);
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  const int first = sweep.reverse ? 0 : 1;
+  const int shift = sweep.reverse ? 1 : -1;
+  // with w_diff = dz * h_prev^T, u_diff = w_diff * v^T and
+  // v_diff = u^T * w_diff
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int i = first; i < first + sweep.steps - 1; ++i) {
+      const int offset = g * sweep.group_stride + i * sweep.step_stride;
+      const Dtype* h_prev = h + offset + shift * sweep.step_stride;
+      irnn_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, rank, L, NH,
+          Dtype(1.), v, NH, h_prev, sweep.ld, Dtype(0.), tmp, L);
+      irnn_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, NH, rank, L, Dtype(1.),
+          dz + offset, sweep.ld, tmp, L, Dtype(1.), u_diff, rank);
+      irnn_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, rank, L, NH, Dtype(1.),
+          u, rank, dz + offset, sweep.ld, Dtype(0.), tmp, L);
+      irnn_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, rank, NH, L, Dtype(1.),
+          tmp, L, h_prev, sweep.ld, Dtype(1.), v_diff, NH);
+    }
+  }
+}
+
+template void irnn_weight_diff_cpu<float>(const IRNNSweep& sweep,
+    const int rank, const float* u, const float* v, const float* h,
+    const float* dz, float* tmp, float* u_diff, float* v_diff);
+template void irnn_weight_diff_cpu<double>(const IRNNSweep& sweep,
+    const int rank, const double* u, const double* v, const double* h,
+    const double* dz, double* tmp, double* u_diff, double* v_diff);
+
+template <typename Dtype>
+void irnn_backward_cpu(const IRNNSweep& sweep, const int rank,
+    const Dtype* u, const Dtype* v, const Dtype* h, const Dtype* top_diff,
+    Dtype* bottom_diff, Dtype* carry, Dtype* tmp, Dtype* u_diff,
+    Dtype* v_diff) {
+  const int slabs = irnn_cpu_slabs(sweep, irnn_cpu_workers());
+  IRNN_PROFILE_CAPTURE();
+#ifdef _OPENMP
+#pragma omp parallel for if (slabs > 1)
+#endif
+  for (int slab = 0; slab < slabs; ++slab) {
+    IRNN_PROFILE_ATTACH();
+    irnn_backward_chain_cpu(sweep, rank, u, v, h, top_diff, bottom_diff,
+        carry, tmp, slab, slabs);
+  }
+  irnn_weight_diff_cpu(sweep, rank, u, v, h, bottom_diff, tmp, u_diff,
+      v_diff);
+}
+
+template void irnn_backward_cpu<float>(const IRNNSweep& sweep,
+    const int rank, const float* u, const float* v, const float* h,
+    const float* top_diff, float* bottom_diff, float* carry, float* tmp,
+    float* u_diff, float* v_diff);
+template void irnn_backward_cpu<double>(const IRNNSweep& sweep,
+    const int rank, const double* u, const double* v, const double* h,
+    const double* top_diff, double* bottom_diff, double* carry, double* tmp,
+    double* u_diff, double* v_diff);
+
+template <typename Dtype>
+void irnn_diagonal_forward_cpu(const IRNNSweep& sweep, const Dtype* w,
+    Dtype* h, const int slab, const int slabs) {
+  const int begin = slab * sweep.length / slabs;
+  const int end = (slab + 1) * sweep.length / slabs;
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int t = begin; t < end; t += sweep.tile) {
+      const int cols = std::min(sweep.tile, end - t);
+      Dtype* h_t = h + g * sweep.group_stride + t;
+      for (int s = 0; s < sweep.steps; ++s) {
+        const int i = sweep.reverse ? sweep.steps - 1 - s : s;
+        const int prev = sweep.reverse ? i + 1 : i - 1;
+        Dtype* h_i = h_t + i * sweep.step_stride;
+        IRNN_PROFILE_TIME(STEP);
+        for (int c = 0; c < sweep.channels; ++c) {
+          Dtype* row = h_i + c * sweep.ld;
+          if (s == 0) {
+            irnn_relu_cpu(cols, row);
+            continue;
+          }
+          // the multiply-add and the ReLU in one pass
+          irnn_axpy_relu_cpu(cols, w[c],
+              h_t + prev * sweep.step_stride + c * sweep.ld, row);
+        }
+      }
+    }
+  }
+}
+
+template void irnn_diagonal_forward_cpu<float>(const IRNNSweep& sweep,
+    const float* w, float* h, const int slab, const int slabs);
+template void irnn_diagonal_forward_cpu<double>(const IRNNSweep& sweep,
+    const double* w, double* h, const int slab, const int slabs);
+
+template <typename Dtype>
+void irnn_diagonal_forward_cpu(const IRNNSweep& sweep, const Dtype* w,
+    Dtype* h) {
+  const int slabs = irnn_cpu_slabs(sweep, irnn_cpu_workers());
+  IRNN_PROFILE_CAPTURE();
+#ifdef _OPENMP
+#pragma omp parallel for if (slabs > 1)
+#endif
+  for (int slab = 0; slab < slabs; ++slab) {
+    IRNN_PROFILE_ATTACH();
+    irnn_diagonal_forward_cpu(sweep, w, h, slab, slabs);
+  }
+}
+
+template void irnn_diagonal_forward_cpu<float>(const IRNNSweep& sweep,
+    const float* w, float* h);
+template void irnn_diagonal_forward_cpu<double>(const IRNNSweep& sweep,
+    const double* w, double* h);
+
+template <typename Dtype>
+void irnn_diagonal_backward_chain_cpu(const IRNNSweep& sweep,
+    const Dtype* w, const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff,
+    Dtype* carry, const int slab, const int slabs) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  const int begin = slab * L / slabs;
+  const int end = (slab + 1) * L / slabs;
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int t = begin; t < end; t += sweep.tile) {
+      const int cols = std::min(sweep.tile, end - t);
+      Dtype* carry_t = carry + t;
+      for (int c = 0; c < NH; ++c) {
+        caffe_set(cols, Dtype(0.), carry_t + c * L);
+      }
+      for (int s = 0; s < sweep.steps; ++s) {
+        const int i = sweep.reverse ? s : sweep.steps - 1 - s;
+        const int offset = g * sweep.group_stride + i * sweep.step_stride + t;
+        // dzdf, and dzdhh = w .* dz for the next step, all of it counted as
+        // the ReLU gradient as there is no GEMM to tell apart
+        IRNN_PROFILE_TIME(RELU_GRAD);
+        for (int c = 0; c < NH; ++c) {
+          const int row = offset + c * sweep.ld;
+          irnn_relu_grad_scale_cpu(cols, w[c], top_diff + row,
+              carry_t + c * L, h + row, bottom_diff + row);
+        }
+      }
+    }
+  }
+}
+
+template void irnn_diagonal_backward_chain_cpu<float>(
+    const IRNNSweep& sweep, const float* w, const float* h,
+    const float* top_diff, float* bottom_diff, float* carry, const int slab,
+    const int slabs);
+template void irnn_diagonal_backward_chain_cpu<double>(
+    const IRNNSweep& sweep, const double* w, const double* h,
+    const double* top_diff, double* bottom_diff, double* carry,
+    const int slab, const int slabs);
+
+template <typename Dtype>
+void irnn_diagonal_weight_diff_cpu(const IRNNSweep& sweep, const Dtype* h,
+    const Dtype* dz, Dtype* w_diff) {
+  IRNN_PROFILE_TIME(WEIGHT_DIFF);
+  const int first = sweep.reverse ? 0 : 1;
+  const int shift = sweep.reverse ? 1 : -1;
+  // w_diff[c] is the sum of dz .* h_prev over the rows of channel c, so the
+  // channels are summed up independently
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int c = 0; c < sweep.channels; ++c) {
+    Dtype sum = 0;
+    for (int g = 0; g < sweep.groups; ++g) {
+      for (int i = first; i < first + sweep.steps - 1; ++i) {
+        const int offset = g * sweep.group_stride + i * sweep.step_stride +
+            c * sweep.ld;
+        const Dtype* dz_i = dz + offset;
+        const Dtype* h_prev = h + offset + shift * sweep.step_stride;
+        for (int l = 0; l < sweep.length; ++l) {
+          sum += dz_i[l] * h_prev[l];
+        }
+      }
+    }
+    w_diff[c] += sum;
+  }
+}
+
+template void irnn_diagonal_weight_diff_cpu<float>(const IRNNSweep& sweep,
+    const float* h, const float* dz, float* w_diff);
+template void irnn_diagonal_weight_diff_cpu<double>(const IRNNSweep& sweep,
+    const double* h, const double* dz, double* w_diff);
+
+template <typename Dtype>
+void irnn_diagonal_backward_cpu(const IRNNSweep& sweep, const Dtype* w,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    Dtype* w_diff) {
+  const int slabs = irnn_cpu_slabs(sweep, irnn_cpu_workers());
+  IRNN_PROFILE_CAPTURE();
+#ifdef _OPENMP
+#pragma omp parallel for if (slabs > 1)
+#endif
+  for (int slab = 0; slab < slabs; ++slab) {
+    IRNN_PROFILE_ATTACH();
+    irnn_diagonal_backward_chain_cpu(sweep, w, h, top_diff, bottom_diff,
+        carry, slab, slabs);
+  }
+  irnn_diagonal_weight_diff_cpu(sweep, h, bottom_diff, w_diff);
+}
+
+template void irnn_diagonal_backward_cpu<float>(const IRNNSweep& sweep,
+    const float* w, const float* h, const float* top_diff,
+    float* bottom_diff, float* carry, float* w_diff);
+template void irnn_diagonal_backward_cpu<double>(const IRNNSweep& sweep,
+    const double* w, const double* h, const double* top_diff,
+    double* bottom_diff, double* carry, double* w_diff);
+
+IRNNSweep irnn_block_sweep(const IRNNSweep& sweep, const int blocks) {
+  IRNNSweep block = sweep;
+  block.channels = sweep.channels / blocks;
+  return block;
+}
+
+template <typename Dtype>
+void irnn_block_forward_cpu(const IRNNSweep& sweep, const int blocks,
+    const Dtype* w, Dtype* h) {
+  IRNNSweep block = irnn_block_sweep(sweep, blocks);
+  // a narrower block takes wider tiles
+  block.tile = irnn_cpu_tile<Dtype>(block);
+  const int NB = block.channels;
+  const int slabs = irnn_cpu_slabs(block, irnn_cpu_workers());
+  // the blocks are as independent as the slabs
+  IRNN_PROFILE_CAPTURE();
+#ifdef _OPENMP
+#pragma omp parallel for if (blocks * slabs > 1)
+#endif
+  for (int task = 0; task < blocks * slabs; ++task) {
+    IRNN_PROFILE_ATTACH();
+    const int b = task / slabs;
+    irnn_forward_cpu(block, w + b * NB * NB, h + b * NB * sweep.ld,
+        task % slabs, slabs);
+  }
+}
+
+template void irnn_block_forward_cpu<float>(const IRNNSweep& sweep,
+    const int blocks, const float* w, float* h);
+template void irnn_block_forward_cpu<double>(const IRNNSweep& sweep,
+    const int blocks, const double* w, double* h);
+
+template <typename Dtype>
+void irnn_block_backward_cpu(const IRNNSweep& sweep, const int blocks,
+    const Dtype* w, const Dtype* h, const Dtype* top_diff,
+    Dtype* bottom_diff, Dtype* carry, Dtype* w_diff) {
+  IRNNSweep block = irnn_block_sweep(sweep, blocks);
+  block.tile = irnn_cpu_tile<Dtype>(block);
+  const int NB = block.channels;
+  const int L = sweep.length;
+  const int slabs = irnn_cpu_slabs(block, irnn_cpu_workers());
+  IRNN_PROFILE_CAPTURE();
+#ifdef _OPENMP
+#pragma omp parallel for if (blocks * slabs > 1)
+#endif
+  for (int task = 0; task < blocks * slabs; ++task) {
+    IRNN_PROFILE_ATTACH();
+    const int b = task / slabs;
+    const int offset = b * NB * sweep.ld;
+    irnn_backward_chain_cpu(block, w + b * NB * NB, h + offset,
+        top_diff + offset, bottom_diff + offset, carry + b * NB * L,
+        task % slabs, slabs);
+  }
+  for (int b = 0; b < blocks; ++b) {
+    irnn_weight_diff_cpu(block, h + b * NB * sweep.ld,
+        bottom_diff + b * NB * sweep.ld, w_diff + b * NB * NB);
+  }
+}
+
+template void irnn_block_backward_cpu<float>(const IRNNSweep& sweep,
+    const int blocks, const float* w, const float* h, const float* top_diff,
+    float* bottom_diff, float* carry, float* w_diff);
+template void irnn_block_backward_cpu<double>(const IRNNSweep& sweep,
+    const int blocks, const double* w, const double* h,
+    const double* top_diff, double* bottom_diff, double* carry,
+    double* w_diff);
+
+template <typename Dtype>
+void irnn_backward_chain_cpu(const IRNNSweep& sweep, const Dtype* w,
+    const irnn_bf16* h, irnn_bf16* diff, Dtype* carry, Dtype* dz_step,
+    const int slab, const int slabs) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  const int begin = slab * L / slabs;
+  const int end = (slab + 1) * L / slabs;
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int t = begin; t < end; t += sweep.tile) {
+      const int cols = std::min(sweep.tile, end - t);
+      Dtype* carry_t = carry + t;
+      Dtype* dz_t = dz_step + t;
+      for (int c = 0; c < NH; ++c) {
+        caffe_set(cols, Dtype(0.), carry_t + c * L);
+      }
+      for (int s = 0; s < sweep.steps; ++s) {
+        const int i = sweep.reverse ? s : sweep.steps - 1 - s;
+        const int offset = g * sweep.group_stride + i * sweep.step_stride + t;
+        // dzdf, kept in Dtype for the carry and stored in bf16
+        {
+          IRNN_PROFILE_TIME(RELU_GRAD);
+          for (int c = 0; c < NH; ++c) {
+            const int row = offset + c * sweep.ld;
+            const Dtype* carry_c = carry_t + c * L;
+            Dtype* dz_c = dz_t + c * L;
+            for (int l = 0; l < cols; ++l) {
+              dz_c[l] = (irnn_from_bf16(diff[row + l]) + carry_c[l]) *
+                  (irnn_from_bf16(h[row + l]) > 0);
+              diff[row + l] = irnn_to_bf16(dz_c[l]);
+            }
+          }
+        }
+        if (s == sweep.steps - 1) {
+          continue;
+        }
+        IRNN_PROFILE_TIME(CHAIN_GEMM);
+        // dzdhh
+        irnn_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, NH, cols, NH,
+            Dtype(1.), w, NH, dz_t, L, Dtype(0.), carry_t, L);
+      }
+    }
+  }
+}
+
+template void irnn_backward_chain_cpu<float>(const IRNNSweep& sweep,
+    const float* w, const irnn_bf16* h, irnn_bf16* diff, float* carry,
+    float* dz_step, const int slab, const int slabs);
+template void irnn_backward_chain_cpu<double>(const IRNNSweep& sweep,
+    const double* w, const irnn_bf16* h, irnn_bf16* diff, double* carry,
+    double* dz_step, const int slab, const int slabs);
+
+// Columns converted for one GEMM of irnn_weight_diff_cpu on bf16 data, at
+// least one step.
+static const int kIRNNWeightDiffColumns = 1024;
+
+// The steps are also capped at a quarter of the sweep, so that the buffer
+// stays within half of a Dtype copy of the hidden states: the bf16 pass
+// then borrows less than the Dtype one, which holds two of them.
+static int irnn_weight_diff_steps(const IRNNSweep& sweep) {
+  return std::max(1, std::min(std::min(sweep.steps - 1,
+      kIRNNWeightDiffColumns / sweep.length), sweep.groups * sweep.steps / 4));
+}
+
+int irnn_weight_diff_buffer(const IRNNSweep& sweep) {
+  return 2 * sweep.channels * irnn_weight_diff_steps(sweep) * sweep.length;
+}
+
+template <typename Dtype>
+void irnn_weight_diff_cpu(const IRNNSweep& sweep, const irnn_bf16* h,
+    const irnn_bf16* dz, Dtype* buffer, Dtype* w_diff) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  if (sweep.steps < 2) {
+    return;
+  }
+  // the conversions along with the GEMMs
+  IRNN_PROFILE_TIME(WEIGHT_DIFF);
+  // dz and h_prev of up to 'chunk' steps side by side, one row per channel
+  const int chunk = irnn_weight_diff_steps(sweep);
+  Dtype* dz_buf = buffer;
+  Dtype* h_buf = buffer + NH * chunk * L;
+  const int first = sweep.reverse ? 0 : 1;
+  const int shift = sweep.reverse ? 1 : -1;
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int i0 = first; i0 < first + sweep.steps - 1; i0 += chunk) {
+      const int steps = std::min(chunk, first + sweep.steps - 1 - i0);
+      for (int c = 0; c < NH; ++c) {
+        for (int i = 0; i < steps; ++i) {
+          const int offset = g * sweep.group_stride +
+              (i0 + i) * sweep.step_stride + c * sweep.ld;
+          const irnn_bf16* dz_i = dz + offset;
+          const irnn_bf16* h_i = h + offset + shift * sweep.step_stride;
+          Dtype* dz_row = dz_buf + c * steps * L + i * L;
+          Dtype* h_row = h_buf + c * steps * L + i * L;
+          for (int l = 0; l < L; ++l) {
+            dz_row[l] = irnn_from_bf16(dz_i[l]);
+            h_row[l] = irnn_from_bf16(h_i[l]);
+          }
+        }
+      }
+      irnn_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, NH, NH, steps * L,
+          Dtype(1.), dz_buf, steps * L, h_buf, steps * L, Dtype(1.), w_diff,
+          NH);
+    }
+  }
+}
+
+template void irnn_weight_diff_cpu<float>(const IRNNSweep& sweep,
+    const irnn_bf16* h, const irnn_bf16* dz, float* buffer, float* w_diff);
+template void irnn_weight_diff_cpu<double>(const IRNNSweep& sweep,
+    const irnn_bf16* h, const irnn_bf16* dz, double* buffer,
+    double* w_diff);
+
+template <typename Dtype>
+void irnn_backward_cpu(const IRNNSweep& sweep, const Dtype* w,
+    const irnn_bf16* h, irnn_bf16* diff, Dtype* carry, Dtype* buffer,
+    Dtype* w_diff) {
+  const int slabs = irnn_cpu_slabs(sweep, irnn_cpu_workers());
+  IRNN_PROFILE_CAPTURE();
+#ifdef _OPENMP
+#pragma omp parallel for if (slabs > 1)
+#endif
+  for (int slab = 0; slab < slabs; ++slab) {
+    IRNN_PROFILE_ATTACH();
+    irnn_backward_chain_cpu(sweep, w, h, diff, carry, buffer, slab, slabs);
+  }
+  irnn_weight_diff_cpu(sweep, h, diff, buffer, w_diff);
+}
+
+template void irnn_backward_cpu<float>(const IRNNSweep& sweep,
+    const float* w, const irnn_bf16* h, irnn_bf16* diff, float* carry,
+    float* buffer, float* w_diff);
+template void irnn_backward_cpu<double>(const IRNNSweep& sweep,
+    const double* w, const irnn_bf16* h, irnn_bf16* diff, double* carry,
+    double* buffer, double* w_diff);
+
+template <typename Dtype>
+void irnn_to_bf16_cpu(const int num, const int channels, const int height,
+    const int width, const bool transpose, const Dtype* src,
+    const int src_stride, irnn_bf16* dst, const int dst_stride) {
+  const int spatial_dim = height * width;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int nc = 0; nc < num * channels; ++nc) {
+    const int n = nc / channels;
+    const int c = nc % channels;
+    const Dtype* src_c = src + n * src_stride + c * spatial_dim;
+    irnn_bf16* dst_c = dst + n * dst_stride + c * spatial_dim;
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        dst_c[transpose ? w * height + h : h * width + w] =
+            irnn_to_bf16(src_c[h * width + w]);
+      }
+    }
+  }
+}
+
+template void irnn_to_bf16_cpu<float>(const int num, const int channels,
+    const int height, const int width, const bool transpose,
+    const float* src, const int src_stride, irnn_bf16* dst,
+    const int dst_stride);
+template void irnn_to_bf16_cpu<double>(const int num, const int channels,
+    const int height, const int width, const bool transpose,
+    const double* src, const int src_stride, irnn_bf16* dst,
+    const int dst_stride);
+
+template <typename Dtype>
+void irnn_from_bf16_cpu(const int num, const int channels, const int height,
+    const int width, const bool transpose, const irnn_bf16* src,
+    const int src_stride, Dtype* dst, const int dst_stride,
+    const bool accumulate) {
+  const int spatial_dim = height * width;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int nc = 0; nc < num * channels; ++nc) {
+    const int n = nc / channels;
+    const int c = nc % channels;
+    const irnn_bf16* src_c = src + n * src_stride + c * spatial_dim;
+    Dtype* dst_c = dst + n * dst_stride + c * spatial_dim;
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        const Dtype x = irnn_from_bf16(src_c[h * width + w]);
+        Dtype& y = dst_c[transpose ? w * height + h : h * width + w];
+        y = accumulate ? y + x : x;
+      }
+    }
+  }
+}
+
+template void irnn_from_bf16_cpu<float>(const int num, const int channels,
+    const int height, const int width, const bool transpose,
+    const irnn_bf16* src, const int src_stride, float* dst,
+    const int dst_stride, const bool accumulate);
+template void irnn_from_bf16_cpu<double>(const int num, const int channels,
+    const int height, const int width, const bool transpose,
+    const irnn_bf16* src, const int src_stride, double* dst,
+    const int dst_stride, const bool accumulate);
+
+template <typename Dtype>
+void irnn_ragged_mask_cpu(const IRNNRaggedLayout& layout, const int* extent,
+    Dtype* x) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int nc = 0; nc < layout.num * layout.channels; ++nc) {
+    const int n = nc / layout.channels;
+    const int c = nc % layout.channels;
+    Dtype* x_c = x + n * layout.num_stride + c * layout.channel_stride;
+    for (int s = 0; s < layout.steps; ++s) {
+      // a whole step past the sample, or its scan lines past the sample
+      const int l0 = s < extent[2 * n] ? extent[2 * n + 1] : 0;
+      for (int l = l0; l < layout.length; ++l) {
+        x_c[s * layout.step_stride + l * layout.line_stride] = Dtype(0.);
+      }
+    }
+  }
+}
+
+template void irnn_ragged_mask_cpu<float>(const IRNNRaggedLayout& layout,
+    const int* extent, float* x);
+template void irnn_ragged_mask_cpu<double>(const IRNNRaggedLayout& layout,
+    const int* extent, double* x);
+
+template <typename Dtype>
+void irnn_transpose_cpu(const int num, const int channels, const int height,
+    const int width, const Dtype* src, const int src_stride, Dtype* dst,
+    const int dst_stride) {
+  const int spatial_dim = height * width;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int nc = 0; nc < num * channels; ++nc) {
+    const int n = nc / channels;
+    const int c = nc % channels;
+    const Dtype* src_c = src + n * src_stride + c * spatial_dim;
+    Dtype* dst_c = dst + n * dst_stride + c * spatial_dim;
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        dst_c[w * height + h] = src_c[h * width + w];
+      }
+    }
+  }
+}
+
+template void irnn_transpose_cpu<float>(const int num, const int channels,
+    const int height, const int width, const float* src, const int src_stride,
+    float* dst, const int dst_stride);
+template void irnn_transpose_cpu<double>(const int num, const int channels,
+    const int height, const int width, const double* src,
+    const int src_stride, double* dst, const int dst_stride);
+
+}  // namespace caffe
@@ -0,0 +1,488 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include "caffe/common.hpp"
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void irnn_gpu_gemm(const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const Dtype alpha, const Dtype* A,
+    const int lda, const Dtype* B, const int ldb, const Dtype beta, Dtype* C,
+    const int ldc);
+
+template <>
+void irnn_gpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  cublasOperation_t cuTransA =
+      (TransA == CblasNoTrans) ? CUBLAS_OP_N : CUBLAS_OP_T;
+  cublasOperation_t cuTransB =
+      (TransB == CblasNoTrans) ? CUBLAS_OP_N : CUBLAS_OP_T;
+  CUBLAS_CHECK(cublasSgemm(Caffe::cublas_handle(), cuTransB, cuTransA,
+      N, M, K, &alpha, B, ldb, A, lda, &beta, C, ldc));
+}
+
+template <>
+void irnn_gpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  cublasOperation_t cuTransA =
+      (TransA == CblasNoTrans) ? CUBLAS_OP_N : CUBLAS_OP_T;
+  cublasOperation_t cuTransB =
+      (TransB == CblasNoTrans) ? CUBLAS_OP_N : CUBLAS_OP_T;
+  CUBLAS_CHECK(cublasDgemm(Caffe::cublas_handle(), cuTransB, cuTransA,
+      N, M, K, &alpha, B, ldb, A, lda, &beta, C, ldc));
+}
+
+template <typename Dtype>
+__global__ void IRNNReLUForward(const int n, const int length, const int ld,
+    Dtype* h) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int i = (index / length) * ld + index % length;
+    h[i] = h[i] > 0 ? h[i] : Dtype(0.);
+  }
+}
+
+template <typename Dtype>
+__global__ void IRNNReLUBackward(const int n, const int length, const int ld,
+    const Dtype* h, const Dtype* top_diff, const Dtype* carry,
+    Dtype* bottom_diff) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int i = (index / length) * ld + index % length;
+    bottom_diff[i] = (top_diff[i] + carry[index]) * (h[i] > 0);
+  }
+}
+
+template <typename Dtype>
+void irnn_forward_gpu(const IRNNSweep& sweep, const Dtype* w, Dtype* h) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  for (int s = 0; s < sweep.steps; ++s) {
+    const int i = sweep.reverse ? sweep.steps - 1 - s : s;
+    const int prev = sweep.reverse ? i + 1 : i - 1;
+    for (int g = 0; g < sweep.groups; ++g) {
+      Dtype* h_i = h + g * sweep.group_stride + i * sweep.step_stride;
+      if (s > 0) {
+        irnn_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, NH, L, NH,
+            Dtype(1.), w, NH,
+            h + g * sweep.group_stride + prev * sweep.step_stride, sweep.ld,
+            Dtype(1.), h_i, sweep.ld);
+      }
+      // NOLINT_NEXT_LINE(whitespace/operators)
+      IRNNReLUForward<Dtype><<<CAFFE_GET_BLOCKS(NH * L),
+          CAFFE_CUDA_NUM_THREADS>>>(NH * L, L, sweep.ld, h_i);
+      CUDA_POST_KERNEL_CHECK;
+    }
+  }
+}
+
+template void irnn_forward_gpu<float>(const IRNNSweep& sweep,
+    const float* w, float* h);
+template void irnn_forward_gpu<double>(const IRNNSweep& sweep,
+    const double* w, double* h);
+
+template <typename Dtype>
+void irnn_backward_gpu(const IRNNSweep& sweep, const Dtype* w,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    Dtype* w_diff) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  for (int g = 0; g < sweep.groups; ++g) {
+    caffe_gpu_set(NH * L, Dtype(0.), carry);
+    for (int s = 0; s < sweep.steps; ++s) {
+      const int i = sweep.reverse ? s : sweep.steps - 1 - s;
+      const int offset = g * sweep.group_stride + i * sweep.step_stride;
+      // dzdf
+      // NOLINT_NEXT_LINE(whitespace/operators)
+      IRNNReLUBackward<Dtype><<<CAFFE_GET_BLOCKS(NH * L),
+          CAFFE_CUDA_NUM_THREADS>>>(NH * L, L, sweep.ld, h + offset,
+          top_diff + offset, carry, bottom_diff + offset);
+      CUDA_POST_KERNEL_CHECK;
+      if (s == sweep.steps - 1) {
+        continue;
+      }
+      // dzdhh
+      irnn_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, NH, L, NH, Dtype(1.),
+          w, NH, bottom_diff + offset, sweep.ld, Dtype(0.), carry, L);
+    }
+  }
+  if (sweep.steps < 2) {
+    return;
+  }
+  // dzdw, see irnn_backward_cpu
+  const int first = sweep.reverse ? 0 : 1;
+  const int shift = sweep.reverse ? 1 : -1;
+  if (sweep.step_stride == L && sweep.ld >= sweep.steps * L) {
+    for (int g = 0; g < sweep.groups; ++g) {
+      const int offset = g * sweep.group_stride + first * L;
+      irnn_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, NH, NH,
+          (sweep.steps - 1) * L, Dtype(1.), bottom_diff + offset, sweep.ld,
+          h + offset + shift * L, sweep.ld, Dtype(1.), w_diff, NH);
+    }
+  } else {
+    for (int g = 0; g < sweep.groups; ++g) {
+      for (int i = first; i < first + sweep.steps - 1; ++i) {
+        const int offset = g * sweep.group_stride + i * sweep.step_stride;
+        irnn_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, NH, NH, L, Dtype(1.),
+            bottom_diff + offset, sweep.ld,
+            h + offset + shift * sweep.step_stride, sweep.ld, Dtype(1.),
+            w_diff, NH);
+      }
+    }
+  }
+}
+
+template void irnn_backward_gpu<float>(const IRNNSweep& sweep,
+    const float* w, const float* h, const float* top_diff,
+    float* bottom_diff, float* carry, float* w_diff);
+template void irnn_backward_gpu<double>(const IRNNSweep& sweep,
+    const double* w, const double* h, const double* top_diff,
+    double* bottom_diff, double* carry, double* w_diff);
+
+template <typename Dtype>
+__global__ void IRNNLowRankReLUForward(const int n, const int length,
+    const int ld, const Dtype* h_prev, Dtype* h) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int i = (index / length) * ld + index % length;
+    const Dtype z = h[i] + h_prev[i];
+    h[i] = z > 0 ? z : Dtype(0.);
+  }
+}
+
+// dst = src for a matrix with rows ld elements apart in src and length
+// elements apart in dst
+template <typename Dtype>
+__global__ void IRNNCopyRows(const int n, const int length, const int ld,
+    const Dtype* src, Dtype* dst) {
+  CUDA_KERNEL_LOOP(index, n) {
+    dst[index] = src[(index / length) * ld + index % length];
+  }
+}
+
+template <typename Dtype>
+void irnn_forward_gpu(const IRNNSweep& sweep, const int rank, const Dtype* u,
+    const Dtype* v, Dtype* h, Dtype* tmp) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  for (int s = 0; s < sweep.steps; ++s) {
+    const int i = sweep.reverse ? sweep.steps - 1 - s : s;
+    const int prev = sweep.reverse ? i + 1 : i - 1;
+    for (int g = 0; g < sweep.groups; ++g) {
+      Dtype* h_i = h + g * sweep.group_stride + i * sweep.step_stride;
+      if (s == 0) {
+        // NOLINT_NEXT_LINE(whitespace/operators)
+        IRNNReLUForward<Dtype><<<CAFFE_GET_BLOCKS(NH * L),
+            CAFFE_CUDA_NUM_THREADS>>>(NH * L, L, sweep.ld, h_i);
+        CUDA_POST_KERNEL_CHECK;
+        continue;
+      }
+      const Dtype* h_prev = h + g * sweep.group_stride +
+          prev * sweep.step_stride;
+      irnn_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, rank, L, NH,
+          Dtype(1.), v, NH, h_prev, sweep.ld, Dtype(0.), tmp, L);
+      irnn_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, NH, L, rank,
+          Dtype(1.), u, rank, tmp, L, Dtype(1.), h_i, sweep.ld);
+      // NOLINT_NEXT_LINE(whitespace/operators)
+      IRNNLowRankReLUForward<Dtype><<<CAFFE_GET_BLOCKS(NH * L),
+          CAFFE_CUDA_NUM_THREADS>>>(NH * L, L, sweep.ld, h_prev, h_i);
+      CUDA_POST_KERNEL_CHECK;
+    }
+  }
+}
+
+template void irnn_forward_gpu<float>(const IRNNSweep& sweep,
+    const int rank, const float* u, const float* v, float* h, float* tmp);
+template void irnn_forward_gpu<double>(const IRNNSweep& sweep,
+    const int rank, const double* u, const double* v, double* h,
+    double* tmp);
+
+template <typename Dtype>
+void irnn_backward_gpu(const IRNNSweep& sweep, const int rank,
+    const Dtype* u, const Dtype* v, const Dtype* h, const Dtype* top_diff,
+    Dtype* bottom_diff, Dtype* carry, Dtype* tmp, Dtype* u_diff,
+    Dtype* v_diff) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  for (int g = 0; g < sweep.groups; ++g) {
+    caffe_gpu_set(NH * L, Dtype(0.), carry);
+    for (int s = 0; s < sweep.steps; ++s) {
+      const int i = sweep.reverse ? s : sweep.steps - 1 - s;
+      const int offset = g * sweep.group_stride + i * sweep.step_stride;
+      // dzdf
+      // NOLINT_NEXT_LINE(whitespace/operators)
+      IRNNReLUBackward<Dtype><<<CAFFE_GET_BLOCKS(NH * L),
+          CAFFE_CUDA_NUM_THREADS>>>(NH * L, L, sweep.ld, h + offset,
+          top_diff + offset, carry, bottom_diff + offset);
+      CUDA_POST_KERNEL_CHECK;
+      if (s == sweep.steps - 1) {
+        continue;
+      }
+      // dzdhh, dz + v^T * (u^T * dz)
+      irnn_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, rank, L, NH, Dtype(1.),
+          u, rank, bottom_diff + offset, sweep.ld, Dtype(0.), tmp, L);
+      // NOLINT_NEXT_LINE(whitespace/operators)
+      IRNNCopyRows<Dtype><<<CAFFE_GET_BLOCKS(NH * L),
+          CAFFE_CUDA_NUM_THREADS>>>(NH * L, L, sweep.ld, bottom_diff + offset,
+          carry);
+      CUDA_POST_KERNEL_CHECK;
+      irnn_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, NH, L, rank, Dtype(1.),
+          v, NH, tmp, L, Dtype(1.), carry, L);
+    }
+  }
+  // u_diff and v_diff, see irnn_weight_diff_cpu
+  const int first = sweep.reverse ? 0 : 1;
+  const int shift = sweep.reverse ? 1 : -1;
+  for (int g = 0; g < sweep.groups; ++g) {
+    for (int i = first; i < first + sweep.steps - 1; ++i) {
+      const int offset = g * sweep.group_stride + i * sweep.step_stride;
+      const Dtype* h_prev = h + offset + shift * sweep.step_stride;
+      irnn_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, rank, L, NH,
+          Dtype(1.), v, NH, h_prev, sweep.ld, Dtype(0.), tmp, L);
+      irnn_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, NH, rank, L, Dtype(1.),
+          bottom_diff + offset, sweep.ld, tmp, L, Dtype(1.), u_diff, rank);
+      irnn_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, rank, L, NH, Dtype(1.),
+          u, rank, bottom_diff + offset, sweep.ld, Dtype(0.), tmp, L);
+      irnn_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, rank, NH, L, Dtype(1.),
+          tmp, L, h_prev, sweep.ld, Dtype(1.), v_diff, NH);
+    }
+  }
+}
+
+template void irnn_backward_gpu<float>(const IRNNSweep& sweep,
+    const int rank, const float* u, const float* v, const float* h,
+    const float* top_diff, float* bottom_diff, float* carry, float* tmp,
+    float* u_diff, float* v_diff);
+template void irnn_backward_gpu<double>(const IRNNSweep& sweep,
+    const int rank, const double* u, const double* v, const double* h,
+    const double* top_diff, double* bottom_diff, double* carry, double* tmp,
+    double* u_diff, double* v_diff);
+
+template <typename Dtype>
+__global__ void IRNNDiagonalForward(const int n, const int length,
+    const int ld, const Dtype* w, const Dtype* h_prev, Dtype* h) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int c = index / length;
+    const int i = c * ld + index % length;
+    const Dtype z = h[i] + w[c] * h_prev[i];
+    h[i] = z > 0 ? z : Dtype(0.);
+  }
+}
+
+// dz as IRNNReLUBackward, and the carry w .* dz for the next step
+template <typename Dtype>
+__global__ void IRNNDiagonalBackward(const int n, const int length,
+    const int ld, const Dtype* w, const Dtype* h, const Dtype* top_diff,
+    Dtype* carry, Dtype* bottom_diff) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int c = index / length;
+    const int i = c * ld + index % length;
+    const Dtype dz = (top_diff[i] + carry[index]) * (h[i] > 0);
+    bottom_diff[i] = dz;
+    carry[index] = w[c] * dz;
+  }
+}
+
+// w_diff[c] += the sum of dz .* h_prev over the rows of channel c. One block
+// per channel: its threads stride over the rows, consecutive threads on
+// consecutive scan lines, and their sums meet in a tree in shared memory.
+template <typename Dtype>
+__global__ void IRNNDiagonalWeightDiff(const IRNNSweep sweep,
+    const int first, const int shift, const Dtype* h, const Dtype* dz,
+    Dtype* w_diff) {
+  __shared__ Dtype buffer[CAFFE_CUDA_NUM_THREADS];
+  const int c = blockIdx.x;
+  const int rows = sweep.steps - 1;
+  const int n = sweep.groups * rows * sweep.length;
+  Dtype sum = 0;
+  for (int index = threadIdx.x; index < n; index += blockDim.x) {
+    const int row = index / sweep.length;
+    const int offset = (row / rows) * sweep.group_stride +
+        (first + row % rows) * sweep.step_stride + c * sweep.ld +
+        index % sweep.length;
+    sum += dz[offset] * h[offset + shift * sweep.step_stride];
+  }
+  buffer[threadIdx.x] = sum;
+  __syncthreads();
+  for (int stride = blockDim.x / 2; stride > 0; stride /= 2) {
+    if (threadIdx.x < stride) {
+      buffer[threadIdx.x] += buffer[threadIdx.x + stride];
+    }
+    __syncthreads();
+  }
+  if (threadIdx.x == 0) {
+    w_diff[c] += buffer[0];
+  }
+}
+
+template <typename Dtype>
+void irnn_diagonal_forward_gpu(const IRNNSweep& sweep, const Dtype* w,
+    Dtype* h) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  for (int s = 0; s < sweep.steps; ++s) {
+    const int i = sweep.reverse ? sweep.steps - 1 - s : s;
+    const int prev = sweep.reverse ? i + 1 : i - 1;
+    for (int g = 0; g < sweep.groups; ++g) {
+      Dtype* h_i = h + g * sweep.group_stride + i * sweep.step_stride;
+      if (s == 0) {
+        // NOLINT_NEXT_LINE(whitespace/operators)
+        IRNNReLUForward<Dtype><<<CAFFE_GET_BLOCKS(NH * L),
+            CAFFE_CUDA_NUM_THREADS>>>(NH * L, L, sweep.ld, h_i);
+      } else {
+        // NOLINT_NEXT_LINE(whitespace/operators)
+        IRNNDiagonalForward<Dtype><<<CAFFE_GET_BLOCKS(NH * L),
+            CAFFE_CUDA_NUM_THREADS>>>(NH * L, L, sweep.ld, w,
+            h + g * sweep.group_stride + prev * sweep.step_stride, h_i);
+      }
+      CUDA_POST_KERNEL_CHECK;
+    }
+  }
+}
+
+template void irnn_diagonal_forward_gpu<float>(const IRNNSweep& sweep,
+    const float* w, float* h);
+template void irnn_diagonal_forward_gpu<double>(const IRNNSweep& sweep,
+    const double* w, double* h);
+
+template <typename Dtype>
+void irnn_diagonal_backward_gpu(const IRNNSweep& sweep, const Dtype* w,
+    const Dtype* h, const Dtype* top_diff, Dtype* bottom_diff, Dtype* carry,
+    Dtype* w_diff) {
+  const int NH = sweep.channels;
+  const int L = sweep.length;
+  for (int g = 0; g < sweep.groups; ++g) {
+    caffe_gpu_set(NH * L, Dtype(0.), carry);
+    for (int s = 0; s < sweep.steps; ++s) {
+      const int i = sweep.reverse ? s : sweep.steps - 1 - s;
+      const int offset = g * sweep.group_stride + i * sweep.step_stride;
+      // NOLINT_NEXT_LINE(whitespace/operators)
+      IRNNDiagonalBackward<Dtype><<<CAFFE_GET_BLOCKS(NH * L),
+          CAFFE_CUDA_NUM_THREADS>>>(NH * L, L, sweep.ld, w, h + offset,
+          top_diff + offset, carry, bottom_diff + offset);
+      CUDA_POST_KERNEL_CHECK;
+    }
+  }
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  IRNNDiagonalWeightDiff<Dtype><<<NH, CAFFE_CUDA_NUM_THREADS>>>(sweep,
+      sweep.reverse ? 0 : 1, sweep.reverse ? 1 : -1, h, bottom_diff, w_diff);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template void irnn_diagonal_backward_gpu<float>(const IRNNSweep& sweep,
+    const float* w, const float* h, const float* top_diff,
+    float* bottom_diff, float* carry, float* w_diff);
+template void irnn_diagonal_backward_gpu<double>(const IRNNSweep& sweep,
+    const double* w, const double* h, const double* top_diff,
+    double* bottom_diff, double* carry, double* w_diff);
+
+template <typename Dtype>
+void irnn_block_forward_gpu(const IRNNSweep& sweep, const int blocks,
+    const Dtype* w, Dtype* h) {
+  const IRNNSweep block = irnn_block_sweep(sweep, blocks);
+  const int NB = block.channels;
+  for (int b = 0; b < blocks; ++b) {
+    irnn_forward_gpu(block, w + b * NB * NB, h + b * NB * sweep.ld);
+  }
+}
+
+template void irnn_block_forward_gpu<float>(const IRNNSweep& sweep,
+    const int blocks, const float* w, float* h);
+template void irnn_block_forward_gpu<double>(const IRNNSweep& sweep,
+    const int blocks, const double* w, double* h);
+
+template <typename Dtype>
+void irnn_block_backward_gpu(const IRNNSweep& sweep, const int blocks,
+    const Dtype* w, const Dtype* h, const Dtype* top_diff,
+    Dtype* bottom_diff, Dtype* carry, Dtype* w_diff) {
+  const IRNNSweep block = irnn_block_sweep(sweep, blocks);
+  const int NB = block.channels;
+  for (int b = 0; b < blocks; ++b) {
+    const int offset = b * NB * sweep.ld;
+    irnn_backward_gpu(block, w + b * NB * NB, h + offset, top_diff + offset,
+        bottom_diff + offset, carry + b * NB * sweep.length,
+        w_diff + b * NB * NB);
+  }
+}
+
+template void irnn_block_backward_gpu<float>(const IRNNSweep& sweep,
+    const int blocks, const float* w, const float* h, const float* top_diff,
+    float* bottom_diff, float* carry, float* w_diff);
+template void irnn_block_backward_gpu<double>(const IRNNSweep& sweep,
+    const int blocks, const double* w, const double* h,
+    const double* top_diff, double* bottom_diff, double* carry,
+    double* w_diff);
+
+template <typename Dtype>
+__global__ void IRNNRaggedMask(const int n, const IRNNRaggedLayout layout,
+    const int* extent, Dtype* x) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int l = index % layout.length;
+    const int s = (index / layout.length) % layout.steps;
+    const int c = (index / layout.length / layout.steps) % layout.channels;
+    const int num = index / layout.length / layout.steps / layout.channels;
+    if (s >= extent[2 * num] || l >= extent[2 * num + 1]) {
+      x[num * layout.num_stride + c * layout.channel_stride +
+          s * layout.step_stride + l * layout.line_stride] = Dtype(0.);
+    }
+  }
+}
+
+template <typename Dtype>
+void irnn_ragged_mask_gpu(const IRNNRaggedLayout& layout, const int* extent,
+    Dtype* x) {
+  const int n = layout.num * layout.channels * layout.steps * layout.length;
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  IRNNRaggedMask<Dtype><<<CAFFE_GET_BLOCKS(n), CAFFE_CUDA_NUM_THREADS>>>(
+      n, layout, extent, x);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template void irnn_ragged_mask_gpu<float>(const IRNNRaggedLayout& layout,
+    const int* extent, float* x);
+template void irnn_ragged_mask_gpu<double>(const IRNNRaggedLayout& layout,
+    const int* extent, double* x);
+
+template <typename Dtype>
+__global__ void IRNNTranspose(const int n, const int dim, const int height,
+    const int width, const Dtype* src, const int src_stride, Dtype* dst,
+    const int dst_stride) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int num = index / dim;
+    const int spatial = index % dim;
+    const int c = spatial / (height * width);
+    const int h = (spatial / width) % height;
+    const int w = spatial % width;
+    dst[num * dst_stride + c * height * width + w * height + h] =
+        src[num * src_stride + spatial];
+  }
+}
+
+template <typename Dtype>
+void irnn_transpose_gpu(const int num, const int channels, const int height,
+    const int width, const Dtype* src, const int src_stride, Dtype* dst,
+    const int dst_stride) {
+  const int dim = channels * height * width;
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  IRNNTranspose<Dtype><<<CAFFE_GET_BLOCKS(num * dim),
+      CAFFE_CUDA_NUM_THREADS>>>(num * dim, dim, height, width, src,
+      src_stride, dst, dst_stride);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template void irnn_transpose_gpu<float>(const int num, const int channels,
+    const int height, const int width, const float* src, const int src_stride,
+    float* dst, const int dst_stride);
+template void irnn_transpose_gpu<double>(const int num, const int channels,
+    const int height, const int width, const double* src,
+    const int src_stride, double* dst, const int dst_stride);
+
+}  // namespace caffe
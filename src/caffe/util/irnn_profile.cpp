@@ -0,0 +1,78 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include <boost/thread.hpp>
+
+#include "caffe/util/irnn_profile.hpp"
+
+namespace caffe {
+
+// The profiles belong to the layers, the threads only point at them.
+static void irnn_profile_detach(IRNNProfile*) {}
+
+static boost::thread_specific_ptr<IRNNProfile> thread_profile_(
+    irnn_profile_detach);
+
+void IRNNProfile::Reset() {
+  std::fill(calls_, calls_ + NUM_COUNTERS, 0);
+  std::fill(nanoseconds_, nanoseconds_ + NUM_COUNTERS, 0);
+  std::fill(high_water_, high_water_ + NUM_WATERMARKS, 0);
+}
+
+const char* IRNNProfile::name(const Counter counter) {
+  static const char* names[NUM_COUNTERS] = {
+    "forward", "backward", "copy", "step", "relu_grad", "chain_gemm",
+    "weight_diff", "bottom_diff"
+  };
+  return names[counter];
+}
+
+const char* IRNNProfile::name(const Watermark watermark) {
+  static const char* names[NUM_WATERMARKS] = {"scratch_bytes", "cache_bytes"};
+  return names[watermark];
+}
+
+void IRNNProfile::Add(const Counter counter, const int64_t nanoseconds) {
+  __sync_fetch_and_add(&calls_[counter], 1);
+  __sync_fetch_and_add(&nanoseconds_[counter], nanoseconds);
+}
+
+void IRNNProfile::Raise(const Watermark watermark, const size_t bytes) {
+  size_t seen = high_water_[watermark];
+  while (bytes > seen) {
+    seen = __sync_val_compare_and_swap(&high_water_[watermark], seen, bytes);
+  }
+}
+
+std::string IRNNProfile::Dump(const std::string& layer) const {
+  std::ostringstream out;
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    const Counter counter = static_cast<Counter>(i);
+    out << layer << " " << name(counter) << ": " << calls(counter)
+        << " calls, " << seconds(counter) * 1000. << " ms\n";
+  }
+  for (int i = 0; i < NUM_WATERMARKS; ++i) {
+    const Watermark watermark = static_cast<Watermark>(i);
+    out << layer << " " << name(watermark) << ": " << high_water(watermark)
+        << "\n";
+  }
+  return out.str();
+}
+
+IRNNProfile* IRNNProfile::current() {
+  return thread_profile_.get();
+}
+
+void IRNNProfile::set_current(IRNNProfile* profile) {
+  thread_profile_.reset(profile);
+}
+
+}  // namespace caffe
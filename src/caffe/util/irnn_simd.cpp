@@ -0,0 +1,375 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <algorithm>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IRNN_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#include "caffe/util/irnn_simd.hpp"
+
+namespace caffe {
+
+// The scalar kernels, which also finish the rows of the vector ones.
+
+template <typename Dtype>
+static inline void irnn_relu_scalar(const int n, Dtype* x) {
+  for (int i = 0; i < n; ++i) {
+    x[i] = std::max(x[i], Dtype(0.));
+  }
+}
+
+template <typename Dtype>
+static inline void irnn_axpy_relu_scalar(const int n, const Dtype alpha,
+    const Dtype* a, Dtype* x) {
+  for (int i = 0; i < n; ++i) {
+    x[i] = std::max(x[i] + alpha * a[i], Dtype(0.));
+  }
+}
+
+template <typename Dtype>
+static inline void irnn_relu_grad_scalar(const int n, const Dtype* top_diff,
+    const Dtype* carry, const Dtype* h, Dtype* dz) {
+  for (int i = 0; i < n; ++i) {
+    dz[i] = h[i] > 0 ? top_diff[i] + carry[i] : Dtype(0.);
+  }
+}
+
+template <typename Dtype>
+static inline void irnn_relu_grad_scale_scalar(const int n,
+    const Dtype alpha, const Dtype* top_diff, Dtype* carry, const Dtype* h,
+    Dtype* dz) {
+  for (int i = 0; i < n; ++i) {
+    const Dtype d = h[i] > 0 ? top_diff[i] + carry[i] : Dtype(0.);
+    dz[i] = d;
+    carry[i] = alpha * d;
+  }
+}
+
+// The float kernels of one instruction set.
+struct IRNNSimdKernels {
+  const char* isa;
+  void (*relu)(const int n, float* x);
+  void (*axpy_relu)(const int n, const float alpha, const float* a,
+      float* x);
+  void (*relu_grad)(const int n, const float* top_diff, const float* carry,
+      const float* h, float* dz);
+  void (*relu_grad_scale)(const int n, const float alpha,
+      const float* top_diff, float* carry, const float* h, float* dz);
+};
+
+static void irnn_relu_float(const int n, float* x) {
+  irnn_relu_scalar(n, x);
+}
+
+static void irnn_axpy_relu_float(const int n, const float alpha,
+    const float* a, float* x) {
+  irnn_axpy_relu_scalar(n, alpha, a, x);
+}
+
+static void irnn_relu_grad_float(const int n, const float* top_diff,
+    const float* carry, const float* h, float* dz) {
+  irnn_relu_grad_scalar(n, top_diff, carry, h, dz);
+}
+
+static void irnn_relu_grad_scale_float(const int n, const float alpha,
+    const float* top_diff, float* carry, const float* h, float* dz) {
+  irnn_relu_grad_scale_scalar(n, alpha, top_diff, carry, h, dz);
+}
+
+#ifdef IRNN_SIMD_X86
+
+// Compiled for their instruction set through the target attribute, so that
+// the rest of Caffe keeps the flags of the build. The loads and stores are
+// unaligned: the rows start wherever a tile or a slab does.
+// max(0, x) rather than max(x, 0) keeps a NaN in x, as std::max does.
+
+__attribute__((target("sse2")))
+static void irnn_relu_sse2(const int n, float* x) {
+  const __m128 zero = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(x + i, _mm_max_ps(zero, _mm_loadu_ps(x + i)));
+  }
+  irnn_relu_scalar(n - i, x + i);
+}
+
+__attribute__((target("sse2")))
+static void irnn_axpy_relu_sse2(const int n, const float alpha,
+    const float* a, float* x) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 alpha_v = _mm_set1_ps(alpha);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 y = _mm_add_ps(_mm_loadu_ps(x + i),
+        _mm_mul_ps(alpha_v, _mm_loadu_ps(a + i)));
+    _mm_storeu_ps(x + i, _mm_max_ps(zero, y));
+  }
+  irnn_axpy_relu_scalar(n - i, alpha, a + i, x + i);
+}
+
+__attribute__((target("sse2")))
+static void irnn_relu_grad_sse2(const int n, const float* top_diff,
+    const float* carry, const float* h, float* dz) {
+  const __m128 zero = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 active = _mm_cmpgt_ps(_mm_loadu_ps(h + i), zero);
+    const __m128 d = _mm_add_ps(_mm_loadu_ps(top_diff + i),
+        _mm_loadu_ps(carry + i));
+    _mm_storeu_ps(dz + i, _mm_and_ps(active, d));
+  }
+  irnn_relu_grad_scalar(n - i, top_diff + i, carry + i, h + i, dz + i);
+}
+
+__attribute__((target("sse2")))
+static void irnn_relu_grad_scale_sse2(const int n, const float alpha,
+    const float* top_diff, float* carry, const float* h, float* dz) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 alpha_v = _mm_set1_ps(alpha);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 active = _mm_cmpgt_ps(_mm_loadu_ps(h + i), zero);
+    const __m128 d = _mm_and_ps(active, _mm_add_ps(
+        _mm_loadu_ps(top_diff + i), _mm_loadu_ps(carry + i)));
+    _mm_storeu_ps(dz + i, d);
+    _mm_storeu_ps(carry + i, _mm_mul_ps(alpha_v, d));
+  }
+  irnn_relu_grad_scale_scalar(n - i, alpha, top_diff + i, carry + i, h + i,
+      dz + i);
+}
+
+__attribute__((target("avx2")))
+static void irnn_relu_avx2(const int n, float* x) {
+  const __m256 zero = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(x + i, _mm256_max_ps(zero, _mm256_loadu_ps(x + i)));
+  }
+  irnn_relu_scalar(n - i, x + i);
+}
+
+__attribute__((target("avx2")))
+static void irnn_axpy_relu_avx2(const int n, const float alpha,
+    const float* a, float* x) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 alpha_v = _mm256_set1_ps(alpha);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 y = _mm256_add_ps(_mm256_loadu_ps(x + i),
+        _mm256_mul_ps(alpha_v, _mm256_loadu_ps(a + i)));
+    _mm256_storeu_ps(x + i, _mm256_max_ps(zero, y));
+  }
+  irnn_axpy_relu_scalar(n - i, alpha, a + i, x + i);
+}
+
+__attribute__((target("avx2")))
+static void irnn_relu_grad_avx2(const int n, const float* top_diff,
+    const float* carry, const float* h, float* dz) {
+  const __m256 zero = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 active = _mm256_cmp_ps(_mm256_loadu_ps(h + i), zero,
+        _CMP_GT_OQ);
+    const __m256 d = _mm256_add_ps(_mm256_loadu_ps(top_diff + i),
+        _mm256_loadu_ps(carry + i));
+    _mm256_storeu_ps(dz + i, _mm256_and_ps(active, d));
+  }
+  irnn_relu_grad_scalar(n - i, top_diff + i, carry + i, h + i, dz + i);
+}
+
+__attribute__((target("avx2")))
+static void irnn_relu_grad_scale_avx2(const int n, const float alpha,
+    const float* top_diff, float* carry, const float* h, float* dz) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 alpha_v = _mm256_set1_ps(alpha);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 active = _mm256_cmp_ps(_mm256_loadu_ps(h + i), zero,
+        _CMP_GT_OQ);
+    const __m256 d = _mm256_and_ps(active, _mm256_add_ps(
+        _mm256_loadu_ps(top_diff + i), _mm256_loadu_ps(carry + i)));
+    _mm256_storeu_ps(dz + i, d);
+    _mm256_storeu_ps(carry + i, _mm256_mul_ps(alpha_v, d));
+  }
+  irnn_relu_grad_scale_scalar(n - i, alpha, top_diff + i, carry + i, h + i,
+      dz + i);
+}
+
+// AVX-512 finishes a row with a masked vector instead of the scalar loop.
+
+__attribute__((target("avx512f")))
+static void irnn_relu_avx512(const int n, float* x) {
+  const __m512 zero = _mm512_setzero_ps();
+  for (int i = 0; i < n; i += 16) {
+    const __mmask16 m = n - i >= 16 ? 0xFFFF : (1u << (n - i)) - 1;
+    _mm512_mask_storeu_ps(x + i, m,
+        _mm512_maskz_max_ps(m, zero, _mm512_maskz_loadu_ps(m, x + i)));
+  }
+}
+
+__attribute__((target("avx512f")))
+static void irnn_axpy_relu_avx512(const int n, const float alpha,
+    const float* a, float* x) {
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 alpha_v = _mm512_set1_ps(alpha);
+  for (int i = 0; i < n; i += 16) {
+    const __mmask16 m = n - i >= 16 ? 0xFFFF : (1u << (n - i)) - 1;
+    const __m512 y = _mm512_add_ps(_mm512_maskz_loadu_ps(m, x + i),
+        _mm512_mul_ps(alpha_v, _mm512_maskz_loadu_ps(m, a + i)));
+    _mm512_mask_storeu_ps(x + i, m, _mm512_maskz_max_ps(m, zero, y));
+  }
+}
+
+__attribute__((target("avx512f")))
+static void irnn_relu_grad_avx512(const int n, const float* top_diff,
+    const float* carry, const float* h, float* dz) {
+  const __m512 zero = _mm512_setzero_ps();
+  for (int i = 0; i < n; i += 16) {
+    const __mmask16 m = n - i >= 16 ? 0xFFFF : (1u << (n - i)) - 1;
+    const __mmask16 active = _mm512_mask_cmp_ps_mask(m,
+        _mm512_maskz_loadu_ps(m, h + i), zero, _CMP_GT_OQ);
+    const __m512 d = _mm512_maskz_add_ps(active,
+        _mm512_maskz_loadu_ps(m, top_diff + i),
+        _mm512_maskz_loadu_ps(m, carry + i));
+    _mm512_mask_storeu_ps(dz + i, m, d);
+  }
+}
+
+__attribute__((target("avx512f")))
+static void irnn_relu_grad_scale_avx512(const int n, const float alpha,
+    const float* top_diff, float* carry, const float* h, float* dz) {
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 alpha_v = _mm512_set1_ps(alpha);
+  for (int i = 0; i < n; i += 16) {
+    const __mmask16 m = n - i >= 16 ? 0xFFFF : (1u << (n - i)) - 1;
+    const __mmask16 active = _mm512_mask_cmp_ps_mask(m,
+        _mm512_maskz_loadu_ps(m, h + i), zero, _CMP_GT_OQ);
+    const __m512 d = _mm512_maskz_add_ps(active,
+        _mm512_maskz_loadu_ps(m, top_diff + i),
+        _mm512_maskz_loadu_ps(m, carry + i));
+    _mm512_mask_storeu_ps(dz + i, m, d);
+    _mm512_mask_storeu_ps(carry + i, m, _mm512_mul_ps(alpha_v, d));
+  }
+}
+
+#endif  // IRNN_SIMD_X86
+
+// Sets kernels to those of isa and returns true if this build has them and
+// the host runs them.
+static bool irnn_find_kernels(const std::string& isa,
+    IRNNSimdKernels* kernels) {
+  if (isa == "scalar") {
+    const IRNNSimdKernels scalar = {"scalar", irnn_relu_float,
+        irnn_axpy_relu_float, irnn_relu_grad_float,
+        irnn_relu_grad_scale_float};
+    *kernels = scalar;
+    return true;
+  }
+#ifdef IRNN_SIMD_X86
+  __builtin_cpu_init();
+  if (isa == "avx512" && __builtin_cpu_supports("avx512f")) {
+    const IRNNSimdKernels avx512 = {"avx512", irnn_relu_avx512,
+        irnn_axpy_relu_avx512, irnn_relu_grad_avx512,
+        irnn_relu_grad_scale_avx512};
+    *kernels = avx512;
+    return true;
+  }
+  if (isa == "avx2" && __builtin_cpu_supports("avx2")) {
+    const IRNNSimdKernels avx2 = {"avx2", irnn_relu_avx2,
+        irnn_axpy_relu_avx2, irnn_relu_grad_avx2, irnn_relu_grad_scale_avx2};
+    *kernels = avx2;
+    return true;
+  }
+  if (isa == "sse2" && __builtin_cpu_supports("sse2")) {
+    const IRNNSimdKernels sse2 = {"sse2", irnn_relu_sse2,
+        irnn_axpy_relu_sse2, irnn_relu_grad_sse2, irnn_relu_grad_scale_sse2};
+    *kernels = sse2;
+    return true;
+  }
+#endif
+  return false;
+}
+
+// The widest kernels the host runs.
+static IRNNSimdKernels irnn_select_kernels() {
+  const char* isas[] = {"avx512", "avx2", "sse2"};
+  IRNNSimdKernels kernels;
+  for (int i = 0; i < 3; ++i) {
+    if (irnn_find_kernels(isas[i], &kernels)) {
+      return kernels;
+    }
+  }
+  irnn_find_kernels("scalar", &kernels);
+  return kernels;
+}
+
+// Selected once, on the first call of any kernel, unless irnn_simd_set_isa
+// picks others.
+static IRNNSimdKernels& irnn_kernels() {
+  static IRNNSimdKernels kernels = irnn_select_kernels();
+  return kernels;
+}
+
+const char* irnn_simd_isa() {
+  return irnn_kernels().isa;
+}
+
+bool irnn_simd_set_isa(const std::string& isa) {
+  return irnn_find_kernels(isa, &irnn_kernels());
+}
+
+template <>
+void irnn_relu_cpu<float>(const int n, float* x) {
+  irnn_kernels().relu(n, x);
+}
+
+template <>
+void irnn_relu_cpu<double>(const int n, double* x) {
+  irnn_relu_scalar(n, x);
+}
+
+template <>
+void irnn_axpy_relu_cpu<float>(const int n, const float alpha,
+    const float* a, float* x) {
+  irnn_kernels().axpy_relu(n, alpha, a, x);
+}
+
+template <>
+void irnn_axpy_relu_cpu<double>(const int n, const double alpha,
+    const double* a, double* x) {
+  irnn_axpy_relu_scalar(n, alpha, a, x);
+}
+
+template <>
+void irnn_relu_grad_cpu<float>(const int n, const float* top_diff,
+    const float* carry, const float* h, float* dz) {
+  irnn_kernels().relu_grad(n, top_diff, carry, h, dz);
+}
+
+template <>
+void irnn_relu_grad_cpu<double>(const int n, const double* top_diff,
+    const double* carry, const double* h, double* dz) {
+  irnn_relu_grad_scalar(n, top_diff, carry, h, dz);
+}
+
+template <>
+void irnn_relu_grad_scale_cpu<float>(const int n, const float alpha,
+    const float* top_diff, float* carry, const float* h, float* dz) {
+  irnn_kernels().relu_grad_scale(n, alpha, top_diff, carry, h, dz);
+}
+
+template <>
+void irnn_relu_grad_scale_cpu<double>(const int n, const double alpha,
+    const double* top_diff, double* carry, const double* h, double* dz) {
+  irnn_relu_grad_scale_scalar(n, alpha, top_diff, carry, h, dz);
+}
+
+}  // namespace caffe
@@ -0,0 +1,69 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <boost/thread.hpp>
+
+#include "caffe/util/irnn_workspace.hpp"
+
+namespace caffe {
+
+// Size of a transparent huge page on x86-64.
+static const size_t kIRNNHugePageBytes = 2 * 1024 * 1024;
+
+static boost::thread_specific_ptr<IRNNWorkspace> thread_workspace_;
+
+IRNNWorkspace& IRNNWorkspace::Get() {
+  if (!thread_workspace_.get()) {
+    thread_workspace_.reset(new IRNNWorkspace());
+  }
+  return *(thread_workspace_.get());
+}
+
+IRNNWorkspace::~IRNNWorkspace() {
+  free(data_);
+}
+
+void* IRNNWorkspace::Borrow(const size_t bytes) {
+  if (bytes <= capacity_) {
+    return data_;
+  }
+  // the old content is scratch, so it is not carried over
+  free(data_);
+  data_ = NULL;
+  size_t align = kAlign;
+  capacity_ = Aligned(bytes);
+  if (huge_pages_) {
+    align = kIRNNHugePageBytes;
+    capacity_ = (bytes + align - 1) / align * align;
+  }
+  CHECK_EQ(0, posix_memalign(&data_, align, capacity_))
+      << "Cannot allocate " << capacity_ << " bytes of IRNN workspace";
+#ifdef MADV_HUGEPAGE
+  if (huge_pages_) {
+    // only advice, the kernel may not have huge pages to give
+    madvise(data_, capacity_, MADV_HUGEPAGE);
+  }
+#endif
+  return data_;
+}
+
+void IRNNWorkspace::Borrow(const int n, const size_t* bytes, void** slices) {
+  size_t total = 0;
+  for (int i = 0; i < n; ++i) {
+    total += Aligned(bytes[i]);
+  }
+  char* data = static_cast<char*>(Borrow(total));
+  for (int i = 0; i < n; ++i) {
+    slices[i] = data;
+    data += Aligned(bytes[i]);
+  }
+}
+
+}  // namespace caffe
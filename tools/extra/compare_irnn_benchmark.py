@@ -0,0 +1,52 @@
+#!/usr/bin/env python
+"""
+Compares two JSON files written by irnn_benchmark --output, e.g. of the
+commits before and after a change.
+
+usage: compare_irnn_benchmark.py before.json after.json [threshold]
+
+Prints the time of every configuration the two runs share and its speedup,
+before / after, for the forward and the backward pass. The configurations
+whose time changed by more than threshold (0.05 by default, i.e. 5%) are
+marked with '*'.
+"""
+import json
+import sys
+
+KEYS = ('layer', 'axis', 'N', 'C', 'H', 'W')
+
+
+def load(path):
+    with open(path) as f:
+        run = json.load(f)
+    return run, dict((tuple(r[k] for k in KEYS), r) for r in run['results'])
+
+
+def main(argv):
+    if len(argv) not in (3, 4):
+        print(__doc__)
+        return 1
+    threshold = float(argv[3]) if len(argv) == 4 else 0.05
+    before_run, before = load(argv[1])
+    after_run, after = load(argv[2])
+    print('%s (%d threads, %s) -> %s (%d threads, %s)' % (
+        before_run['label'] or argv[1], before_run['threads'],
+        before_run.get('isa', '?'), after_run['label'] or argv[2],
+        after_run['threads'], after_run.get('isa', '?')))
+    print('%-9s %4s %4s %5s %4s %4s  %10s %10s %7s  %10s %10s %7s' % (
+        'layer', 'axis', 'N', 'C', 'H', 'W', 'fwd before', 'after',
+        'speedup', 'bwd before', 'after', 'speedup'))
+    for key in sorted(set(before) & set(after)):
+        line = '%-9s %4d %4d %5d %4d %4d' % key
+        for p in ('forward', 'backward'):
+            old = before[key][p + '_ms']
+            new = after[key][p + '_ms']
+            speedup = old / new if new > 0 else float('inf')
+            mark = '*' if abs(speedup - 1) > threshold else ' '
+            line += '  %10.3f %10.3f %6.2fx%s' % (old, new, speedup, mark)
+        print(line)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,55 @@
+#!/usr/bin/env python
+"""
+Converts the dense recurrent weights of a trained net into the low-rank
+form W = I + U * V of the IRNN layers with a 'rank' set.
+
+usage: irnn_low_rank.py dense.prototxt dense.caffemodel \
+           low_rank.prototxt low_rank.caffemodel
+
+low_rank.prototxt is the dense net with 'rank' added to the RNN* layers to
+convert. The truncated SVD of W - I gives the best rank-r approximation of
+W in the Frobenius norm. All other parameters are copied as they are.
+"""
+import sys
+
+import numpy as np
+
+import caffe
+
+IRNN_TYPES = ('RNNUP', 'RNNDOWN', 'RNNLEFT', 'RNNRIGHT')
+
+
+def low_rank(w, rank):
+    u, s, vt = np.linalg.svd(w - np.eye(w.shape[0]))
+    return u[:, :rank] * s[:rank], vt[:rank]
+
+
+def main(argv):
+    if len(argv) != 5:
+        print(__doc__)
+        return 1
+    caffe.set_mode_cpu()
+    dense = caffe.Net(argv[1], argv[2], caffe.TEST)
+    net = caffe.Net(argv[3], caffe.TEST)
+    types = dict(zip(net._layer_names, [l.type for l in net.layers]))
+    for name, params in net.params.items():
+        src = dense.params[name]
+        if types[name] in IRNN_TYPES and len(params) == 2 and len(src) == 1:
+            w = src[0].data
+            rank = params[0].data.shape[1]
+            u, v = low_rank(w, rank)
+            params[0].data[...] = u
+            params[1].data[...] = v
+            error = (np.linalg.norm(w - np.eye(w.shape[0]) - u.dot(v)) /
+                     np.linalg.norm(w))
+            print('{}: rank {} of {}, relative error {:.4f}'.format(
+                name, rank, w.shape[0], error))
+            continue
+        for dst, blob in zip(params, src):
+            dst.data[...] = blob.data
+    net.save(argv[4])
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
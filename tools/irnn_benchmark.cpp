@@ -0,0 +1,314 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+//
+// Times the CPU forward and backward passes of the directional IRNN layers
+// over a grid of shapes and writes the results as JSON, so that two builds
+// can be compared with tools/extra/compare_irnn_benchmark.py.
+//
+// usage: irnn_benchmark [--channels=64,256] [--sizes=6,22] [--nums=1,8]
+//            [--layers=RNNUP,RNNLEFT] [--iterations=10] [--output=out.json]
+//            [--label=name] [--huge_pages]
+//
+// For every layer, channels C, size S and num N the bottom is N*C*S*S, or
+// the permuted layout of the layer with --permuted. Each configuration runs
+// on a fresh thread, so that the scratch it reports is what it borrowed
+// from its own IRNNWorkspace, backed by huge pages with --huge_pages. The
+// reported figures are
+//   *_ms         mean time of a call, *_min_ms the fastest call,
+//   *_gflops     2 * C^2 flops per position and sweep (twice that for the
+//                backward pass, the dz chain and the weight diff) over the
+//                mean time,
+//   *_bytes      the bytes a pass has to move at least: its bottom, top and
+//                weights, and their diffs for the backward pass,
+//   scratch_bytes the workspace the passes borrowed.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/irnn_math.hpp"
+#include "caffe/util/irnn_simd.hpp"
+#include "caffe/util/irnn_workspace.hpp"
+#include "caffe/util/math_functions.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::CPUTimer;
+using caffe::FillerParameter;
+using caffe::IRNNWorkspace;
+using caffe::Layer;
+using caffe::LayerParameter;
+using caffe::LayerRegistry;
+using caffe::shared_ptr;
+using std::string;
+using std::vector;
+
+DEFINE_string(channels, "64,128,256,512,1024",
+    "Comma-separated channels C of the bottom.");
+DEFINE_string(sizes, "6,16,32,64",
+    "Comma-separated heights and widths of the (square) maps.");
+DEFINE_string(nums, "1,8,64", "Comma-separated batch sizes N.");
+DEFINE_string(layers, "RNNUP,RNNDOWN,RNNLEFT,RNNRIGHT",
+    "Comma-separated directional layers to time.");
+DEFINE_bool(permuted, false,
+    "Feed the permuted bottom of axis 0 instead of a N*C*H*W one.");
+DEFINE_int32(iterations, 10, "Timed calls of each pass.");
+DEFINE_int32(warmup, 1, "Untimed calls of each pass before the timed ones.");
+DEFINE_int32(max_mb, 512,
+    "Skip the configurations whose bottom exceeds this many MB.");
+DEFINE_string(output, "", "Optional JSON file to write the results to.");
+DEFINE_string(label, "", "Free-form label of the run, e.g. a commit.");
+DEFINE_bool(huge_pages, false,
+    "Back the IRNN workspace by transparent huge pages (Linux only).");
+
+static vector<int> ParseInts(const string& list) {
+  vector<int> values;
+  std::stringstream stream(list);
+  string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      values.push_back(atoi(item.c_str()));
+    }
+  }
+  return values;
+}
+
+static vector<string> ParseStrings(const string& list) {
+  vector<string> values;
+  std::stringstream stream(list);
+  string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      values.push_back(item);
+    }
+  }
+  return values;
+}
+
+struct Config {
+  string layer;
+  int num;
+  int channels;
+  int size;
+};
+
+struct Result {
+  int axis;
+  double forward_ms;
+  double forward_min_ms;
+  double backward_ms;
+  double backward_min_ms;
+  double forward_gflops;
+  double backward_gflops;
+  int64_t forward_bytes;
+  int64_t backward_bytes;
+  int64_t scratch_bytes;
+};
+
+static bool IsHorizontal(const string& layer) {
+  return layer == "RNNLEFT" || layer == "RNNRIGHT";
+}
+
+static LayerParameter IRNNParam(const string& layer, const int axis,
+    const int channels) {
+  LayerParameter param;
+  param.set_name(layer);
+  param.set_type(layer);
+  FillerParameter* filler;
+  if (layer == "RNNUP") {
+    param.mutable_rnn_up_param()->set_axis(axis);
+    filler = param.mutable_rnn_up_param()->mutable_weight_filler();
+  } else if (layer == "RNNDOWN") {
+    param.mutable_rnn_down_param()->set_axis(axis);
+    filler = param.mutable_rnn_down_param()->mutable_weight_filler();
+  } else if (layer == "RNNLEFT") {
+    param.mutable_rnn_left_param()->set_axis(axis);
+    filler = param.mutable_rnn_left_param()->mutable_weight_filler();
+  } else {
+    CHECK_EQ(layer, "RNNRIGHT") << "Unknown directional layer " << layer;
+    param.mutable_rnn_right_param()->set_axis(axis);
+    filler = param.mutable_rnn_right_param()->mutable_weight_filler();
+  }
+  // small enough that the hidden states neither vanish nor explode
+  filler->set_type("gaussian");
+  filler->set_std(0.5 / sqrt(static_cast<double>(channels)));
+  return param;
+}
+
+// Runs on a thread of its own, see the top of the file.
+static void Run(const Config& config, Result* result) {
+  Caffe::set_mode(Caffe::CPU);
+  // before the first pass allocates the workspace of this thread
+  IRNNWorkspace::Get().set_huge_pages(FLAGS_huge_pages);
+  const int N = config.num;
+  const int C = config.channels;
+  const int S = config.size;
+  const bool horizontal = IsHorizontal(config.layer);
+  vector<int> shape(4);
+  if (FLAGS_permuted) {
+    // 'W*C*H*N' for left/right, 'H*C*N*W' for up/down
+    shape[0] = S;
+    shape[1] = C;
+    shape[2] = horizontal ? S : N;
+    shape[3] = horizontal ? N : S;
+    result->axis = 0;
+  } else {
+    shape[0] = N;
+    shape[1] = C;
+    shape[2] = S;
+    shape[3] = S;
+    result->axis = horizontal ? 3 : 2;
+  }
+  Blob<float> bottom(shape);
+  Blob<float> top;
+  caffe::caffe_rng_uniform<float>(bottom.count(), -1, 1,
+      bottom.mutable_cpu_data());
+  vector<Blob<float>*> bottom_vec(1, &bottom);
+  vector<Blob<float>*> top_vec(1, &top);
+  shared_ptr<Layer<float> > layer = LayerRegistry<float>::CreateLayer(
+      IRNNParam(config.layer, result->axis, C));
+  layer->SetUp(bottom_vec, top_vec);
+  caffe::caffe_rng_uniform<float>(top.count(), -1, 1,
+      top.mutable_cpu_diff());
+  const vector<bool> propagate_down(1, true);
+
+  CPUTimer timer;
+  double total[2] = {0, 0};
+  double fastest[2] = {0, 0};
+  for (int i = -FLAGS_warmup; i < FLAGS_iterations; ++i) {
+    for (int pass = 0; pass < 2; ++pass) {
+      timer.Start();
+      if (pass == 0) {
+        layer->Forward(bottom_vec, top_vec);
+      } else {
+        layer->Backward(top_vec, propagate_down, bottom_vec);
+      }
+      const double ms = timer.MicroSeconds() / 1000.;
+      if (i < 0) {
+        continue;
+      }
+      total[pass] += ms;
+      if (i == 0 || ms < fastest[pass]) {
+        fastest[pass] = ms;
+      }
+    }
+  }
+  const int iterations = std::max(FLAGS_iterations, 1);
+  result->forward_ms = total[0] / iterations;
+  result->backward_ms = total[1] / iterations;
+  result->forward_min_ms = fastest[0];
+  result->backward_min_ms = fastest[1];
+  // 2 * C^2 flops for every position a sweep moves over
+  const double flops = 2. * C * C * N * S * S;
+  result->forward_gflops = flops / result->forward_ms * 1e-6;
+  result->backward_gflops = 2. * flops / result->backward_ms * 1e-6;
+  const int64_t data = static_cast<int64_t>(bottom.count()) * sizeof(float);
+  const int64_t weights = static_cast<int64_t>(C) * C * sizeof(float);
+  result->forward_bytes = 2 * data + weights;
+  result->backward_bytes = 3 * data + 2 * weights;
+  result->scratch_bytes = IRNNWorkspace::Get().capacity();
+}
+
+static string ToJSON(const Config& config, const Result& result) {
+  char line[1024];
+  snprintf(line, sizeof(line),
+      "{\"layer\": \"%s\", \"axis\": %d, \"N\": %d, \"C\": %d, \"H\": %d, "
+      "\"W\": %d, \"forward_ms\": %.4f, \"forward_min_ms\": %.4f, "
+      "\"backward_ms\": %.4f, \"backward_min_ms\": %.4f, "
+      "\"forward_gflops\": %.3f, \"backward_gflops\": %.3f, "
+      "\"forward_bytes\": %lld, \"backward_bytes\": %lld, "
+      "\"scratch_bytes\": %lld}",
+      config.layer.c_str(), result.axis, config.num, config.channels,
+      config.size, config.size, result.forward_ms, result.forward_min_ms,
+      result.backward_ms, result.backward_min_ms, result.forward_gflops,
+      result.backward_gflops, static_cast<long long>(result.forward_bytes),
+      static_cast<long long>(result.backward_bytes),
+      static_cast<long long>(result.scratch_bytes));
+  return line;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Times the CPU passes of the directional IRNN "
+      "layers.\nusage: irnn_benchmark [FLAGS]");
+  caffe::GlobalInit(&argc, &argv);
+  CHECK_GE(FLAGS_iterations, 1);
+  CHECK_GE(FLAGS_warmup, 0);
+
+  const vector<string> layers = ParseStrings(FLAGS_layers);
+  const vector<int> channels = ParseInts(FLAGS_channels);
+  const vector<int> sizes = ParseInts(FLAGS_sizes);
+  const vector<int> nums = ParseInts(FLAGS_nums);
+  vector<string> records;
+  for (int l = 0; l < layers.size(); ++l) {
+    for (int c = 0; c < channels.size(); ++c) {
+      for (int s = 0; s < sizes.size(); ++s) {
+        for (int n = 0; n < nums.size(); ++n) {
+          Config config;
+          config.layer = layers[l];
+          config.num = nums[n];
+          config.channels = channels[c];
+          config.size = sizes[s];
+          const double mb = static_cast<double>(config.num) *
+              config.channels * config.size * config.size * sizeof(float) /
+              (1 << 20);
+          if (mb > FLAGS_max_mb) {
+            LOG(INFO) << "Skipping " << config.layer << " N=" << config.num
+                << " C=" << config.channels << " H=W=" << config.size
+                << ", its bottom takes " << mb << " MB";
+            continue;
+          }
+          Result result;
+          boost::thread thread(Run, boost::cref(config), &result);
+          thread.join();
+          LOG(INFO) << config.layer << " N=" << config.num << " C="
+              << config.channels << " H=W=" << config.size << ": forward "
+              << result.forward_ms << " ms, " << result.forward_gflops
+              << " GFLOP/s, backward " << result.backward_ms << " ms, "
+              << result.backward_gflops << " GFLOP/s, scratch "
+              << result.scratch_bytes << " bytes";
+          records.push_back(ToJSON(config, result));
+        }
+      }
+    }
+  }
+
+  if (!FLAGS_output.empty()) {
+    FILE* file = fopen(FLAGS_output.c_str(), "w");
+    CHECK(file) << "Cannot write " << FLAGS_output;
+    fprintf(file, "{\n  \"label\": \"%s\",\n  \"threads\": %d,\n"
+        "  \"isa\": \"%s\",\n  \"huge_pages\": %s,\n"
+        "  \"iterations\": %d,\n  \"results\": [\n",
+        FLAGS_label.c_str(), caffe::irnn_cpu_workers(), caffe::irnn_simd_isa(),
+        FLAGS_huge_pages ? "true" : "false", FLAGS_iterations);
+    for (int i = 0; i < records.size(); ++i) {
+      fprintf(file, "    %s%s\n", records[i].c_str(),
+          i + 1 < records.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    LOG(INFO) << "Wrote " << records.size() << " results to "
+        << FLAGS_output;
+  }
+  return 0;
+}
@@ -0,0 +1,286 @@
+// ------------------------------------------------------------------
+// SIAMESE RECURRENT ARCHITECTURE FOR VISUAL TRACKING
+// Version 1.0, Copyright(c) July, 2017
+// Xiaqing Xu, Bingpeng Ma, Hong Chang, Xilin Chen
+// Written by Xiaqing Xu
+// ------------------------------------------------------------------
+//
+// Times a whole spatial-IRNN block, as in models/example.prototxt, the way a
+// Siamese tracker runs it: on the exemplar map and on the search map of each
+// frame, at batch 1 and at training batch sizes.
+//
+// usage: irnn_block_benchmark [--model=models/example.prototxt]
+//            [--batches=1,8,32] [--frames=100] [--backward]
+//            [--output=block.json] [--label=name]
+//
+// The block is built twice from the model, with an Input layer feeding the
+// blob no layer produces ('pool5'): once on the exemplar map and once on
+// the search map, the two sharing their weights like the branches of the
+// tracker. Every frame fills both inputs with fresh random data and runs
+// the exemplar branch, then the search branch, timing every layer. For each
+// batch size it reports
+//   - the latency of a pair (exemplar and search) and of a search pass
+//     alone, as once the exemplar is known, at the 50th and 99th percentile,
+//   - frames per second of pairs and of search passes,
+//   - the share of the time taken by the IRNN layers, the 1x1 convolutions
+//     and the glue between them (permute, split, concat).
+// With --backward the frames also run the backward pass, in the TRAIN phase.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::Layer;
+using caffe::LayerParameter;
+using caffe::Net;
+using caffe::NetParameter;
+using caffe::Timer;
+using caffe::shared_ptr;
+using std::map;
+using std::string;
+using std::vector;
+
+DEFINE_string(model, "models/example.prototxt",
+    "The spatial-IRNN block to time, e.g. models/fused_example.prototxt.");
+DEFINE_int32(channels, 256, "Channels of the input of the block.");
+DEFINE_int32(exemplar_size, 6, "Height and width of the exemplar map.");
+DEFINE_int32(search_size, 22, "Height and width of the search map.");
+DEFINE_string(batches, "1,8,32", "Comma-separated batch sizes to time.");
+DEFINE_int32(frames, 100, "Timed frames per batch size.");
+DEFINE_int32(warmup, 5, "Untimed frames per batch size.");
+DEFINE_bool(backward, false,
+    "Also run the backward pass, as in training, in the TRAIN phase.");
+DEFINE_int32(gpu, -1, "Run on this GPU instead of the CPU.");
+DEFINE_string(output, "", "Optional JSON file to write the results to.");
+DEFINE_string(label, "", "Free-form label of the run, e.g. a commit.");
+
+static vector<int> ParseInts(const string& list) {
+  vector<int> values;
+  std::stringstream stream(list);
+  string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      values.push_back(atoi(item.c_str()));
+    }
+  }
+  return values;
+}
+
+// What a layer of the block is there for.
+static string Category(const string& type) {
+  if (type == "RNNUP" || type == "RNNDOWN" || type == "RNNLEFT" ||
+      type == "RNNRIGHT" || type == "SpatialIRNN") {
+    return "irnn";
+  }
+  if (type == "Convolution") {
+    return "conv";
+  }
+  if (type == "Permute" || type == "Split" || type == "Concat") {
+    return "glue";
+  }
+  return "other";
+}
+
+// The blob the block reads without any of its layers producing it.
+static string InputBlob(const NetParameter& param) {
+  std::set<string> produced;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    for (int j = 0; j < layer.bottom_size(); ++j) {
+      if (!produced.count(layer.bottom(j))) {
+        return layer.bottom(j);
+      }
+    }
+    for (int j = 0; j < layer.top_size(); ++j) {
+      produced.insert(layer.top(j));
+    }
+  }
+  LOG(FATAL) << FLAGS_model << " reads no input";
+  return "";
+}
+
+// The block of FLAGS_model on a num x channels x size x size input.
+static shared_ptr<Net<float> > BuildBlock(const int num, const int size) {
+  NetParameter block;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &block);
+  NetParameter param;
+  param.set_name(block.name());
+  param.set_force_backward(FLAGS_backward);
+  param.mutable_state()->set_phase(FLAGS_backward ? caffe::TRAIN :
+      caffe::TEST);
+  LayerParameter* input = param.add_layer();
+  input->set_name("input");
+  input->set_type("Input");
+  input->add_top(InputBlob(block));
+  caffe::BlobShape* shape = input->mutable_input_param()->add_shape();
+  shape->add_dim(num);
+  shape->add_dim(FLAGS_channels);
+  shape->add_dim(size);
+  shape->add_dim(size);
+  for (int i = 0; i < block.layer_size(); ++i) {
+    param.add_layer()->CopyFrom(block.layer(i));
+  }
+  return shared_ptr<Net<float> >(new Net<float>(param));
+}
+
+// Time per category of the layers of a branch.
+typedef map<string, double> Breakdown;
+
+// Runs one frame of a branch on fresh data, layer by layer, and returns its
+// time in ms.
+static double RunBranch(Net<float>* net, Breakdown* breakdown) {
+  // the top of the Input layer
+  Blob<float>* input = net->top_vecs()[0][0];
+  caffe::caffe_rng_uniform<float>(input->count(), -1, 1,
+      input->mutable_cpu_data());
+  const vector<shared_ptr<Layer<float> > >& layers = net->layers();
+  Timer timer;
+  double total = 0;
+  // layer 0 is the Input layer
+  for (int i = 1; i < layers.size(); ++i) {
+    timer.Start();
+    net->ForwardFromTo(i, i);
+    const double ms = timer.MicroSeconds() / 1000.;
+    (*breakdown)[Category(layers[i]->type())] += ms;
+    total += ms;
+  }
+  if (!FLAGS_backward) {
+    return total;
+  }
+  Blob<float>* output = net->output_blobs()[0];
+  caffe::caffe_rng_uniform<float>(output->count(), -1, 1,
+      output->mutable_cpu_diff());
+  net->ClearParamDiffs();
+  for (int i = layers.size() - 1; i > 0; --i) {
+    timer.Start();
+    net->BackwardFromTo(i, i);
+    const double ms = timer.MicroSeconds() / 1000.;
+    (*breakdown)[Category(layers[i]->type())] += ms;
+    total += ms;
+  }
+  return total;
+}
+
+static double Percentile(vector<double> values, const double p) {
+  std::sort(values.begin(), values.end());
+  const int i = std::min<int>(values.size() - 1, p * values.size());
+  return values[i];
+}
+
+static double Mean(const vector<double>& values) {
+  double sum = 0;
+  for (int i = 0; i < values.size(); ++i) {
+    sum += values[i];
+  }
+  return sum / values.size();
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Times a spatial-IRNN block on exemplar/search "
+      "pairs.\nusage: irnn_block_benchmark [FLAGS]");
+  caffe::GlobalInit(&argc, &argv);
+  CHECK_GE(FLAGS_frames, 1);
+  if (FLAGS_gpu >= 0) {
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+  }
+
+  const vector<int> batches = ParseInts(FLAGS_batches);
+  vector<string> records;
+  for (int b = 0; b < batches.size(); ++b) {
+    const int num = batches[b];
+    shared_ptr<Net<float> > exemplar = BuildBlock(num, FLAGS_exemplar_size);
+    shared_ptr<Net<float> > search = BuildBlock(num, FLAGS_search_size);
+    search->ShareTrainedLayersWith(exemplar.get());
+
+    vector<double> pair_ms;
+    vector<double> search_ms;
+    Breakdown breakdown;
+    for (int frame = -FLAGS_warmup; frame < FLAGS_frames; ++frame) {
+      Breakdown frame_breakdown;
+      const double exemplar_time = RunBranch(exemplar.get(), &frame_breakdown);
+      const double search_time = RunBranch(search.get(), &frame_breakdown);
+      if (frame < 0) {
+        continue;
+      }
+      pair_ms.push_back(exemplar_time + search_time);
+      search_ms.push_back(search_time);
+      for (Breakdown::const_iterator it = frame_breakdown.begin();
+          it != frame_breakdown.end(); ++it) {
+        breakdown[it->first] += it->second;
+      }
+    }
+
+    double total = 0;
+    for (Breakdown::const_iterator it = breakdown.begin();
+        it != breakdown.end(); ++it) {
+      total += it->second;
+    }
+    const double pair_fps = num * 1000. / Mean(pair_ms);
+    const double search_fps = num * 1000. / Mean(search_ms);
+    LOG(INFO) << "Batch " << num << ": pair p50 "
+        << Percentile(pair_ms, 0.5) << " ms, p99 "
+        << Percentile(pair_ms, 0.99) << " ms, " << pair_fps
+        << " frames/s; search p50 " << Percentile(search_ms, 0.5)
+        << " ms, p99 " << Percentile(search_ms, 0.99) << " ms, "
+        << search_fps << " frames/s";
+    std::ostringstream shares;
+    for (Breakdown::const_iterator it = breakdown.begin();
+        it != breakdown.end(); ++it) {
+      LOG(INFO) << "  " << it->first << ": " << 100. * it->second / total
+          << "% of the time";
+      shares << ", \"" << it->first << "_share\": "
+          << it->second / total;
+    }
+    char line[512];
+    snprintf(line, sizeof(line),
+        "{\"N\": %d, \"pair_p50_ms\": %.4f, \"pair_p99_ms\": %.4f, "
+        "\"pair_fps\": %.2f, \"search_p50_ms\": %.4f, "
+        "\"search_p99_ms\": %.4f, \"search_fps\": %.2f",
+        num, Percentile(pair_ms, 0.5), Percentile(pair_ms, 0.99), pair_fps,
+        Percentile(search_ms, 0.5), Percentile(search_ms, 0.99),
+        search_fps);
+    records.push_back(line + shares.str() + "}");
+  }
+
+  if (!FLAGS_output.empty()) {
+    FILE* file = fopen(FLAGS_output.c_str(), "w");
+    CHECK(file) << "Cannot write " << FLAGS_output;
+    fprintf(file, "{\n  \"label\": \"%s\",\n  \"model\": \"%s\",\n"
+        "  \"channels\": %d,\n  \"exemplar_size\": %d,\n"
+        "  \"search_size\": %d,\n  \"backward\": %s,\n  \"results\": [\n",
+        FLAGS_label.c_str(), FLAGS_model.c_str(), FLAGS_channels,
+        FLAGS_exemplar_size, FLAGS_search_size,
+        FLAGS_backward ? "true" : "false");
+    for (int i = 0; i < records.size(); ++i) {
+      fprintf(file, "    %s%s\n", records[i].c_str(),
+          i + 1 < records.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    LOG(INFO) << "Wrote " << records.size() << " results to "
+        << FLAGS_output;
+  }
+  return 0;
+}